@@ -1,6 +1,12 @@
 #include "chngDet.hpp"
 #include "../util/meshProcess.hpp"
+#include "../util/spanMask.hpp"
+#include "../util/maskComponents.hpp"
+#include "../util/camVisibility.hpp"
+#include "../util/leafKeyIndex.hpp"
 #include "../maxflowLib/graph.h"
+#include "../maxflowLib/gridGraph.h"
+#include "../maxflowLib/parallelGraph.h"
 
 #include <pcl/octree/octree.h>
 #include <pcl/octree/octree_pointcloud_adjacency.h>
@@ -9,9 +15,15 @@
 #include <pcl/visualization/pcl_visualizer.h>
 #include <pcl/io/ply_io.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <iostream>
 #include <map>
 #include <cmath>
+#include <climits>
+#include <algorithm>
 cv::Mat ImgChangeDetector::getImageDifference(cv::Mat img1, cv::Mat img2){
   return cv::abs(img1 - img2);
 }
@@ -24,236 +36,646 @@ std::vector<vcg::Point3f> ImgChangeDetector::projChngMask(cv::Mat chngMask, vcg:
 }
 
 void ImgChangeDetector::imgDiffThres(cv::Mat im1, cv::Mat im2, cv::Mat H, cv::Mat &mask){
+  ImgFootprint footprint;
+  imgDiffThres(im1, im2, H, mask, footprint);
+}
+
+/**
+Function computes the change mask of two registered images. Only the footprint of im2 warped into im1 is differenced and thresholded, everything outside of it is left unchanged in the mask.
+*/
+void ImgChangeDetector::imgDiffThres(cv::Mat im1, cv::Mat im2, cv::Mat H, cv::Mat &mask, ImgFootprint &footprint){
   
-  cv::Mat im1_trans;
+  mask = cv::Mat::zeros(im1.size(), CV_8UC1);
+
+  if(!ImgProcessing::getWarpFootprint(H, im1.size(), im2.size(), footprint))
+    return;
 
-  warpPerspective(im1, im1_trans, H, im1.size());
+  //Bounding box of the footprint warped into the second image
+  std::vector<cv::Point2f> warped_quad;
+  cv::perspectiveTransform(footprint.quad, warped_quad, H);
+  cv::Rect roi2 = cv::boundingRect(warped_quad) & cv::Rect(0, 0, im2.cols, im2.rows);
+
+  if(roi2.area() == 0){
+    footprint = ImgFootprint();
+    return;
+  }
+
+  //Homographies restricted to the bounding boxes
+  cv::Mat H64;
+  H.convertTo(H64, CV_64F);
+  cv::Mat T2 = (cv::Mat_<double>(3,3) << 1, 0, -roi2.x, 0, 1, -roi2.y, 0, 0, 1);
+  cv::Mat T1 = (cv::Mat_<double>(3,3) << 1, 0, footprint.bbox.x, 0, 1, footprint.bbox.y, 0, 0, 1);
+  cv::Mat H_roi2 = T2*H64;
+  cv::Mat H_rois = H_roi2*T1;
+
+  cv::Mat im1_trans;
+  warpPerspective(im1, im1_trans, H_roi2, roi2.size());
       
-  cv::Mat diffImg(cv::abs(im2-im1_trans));  
-  cv::Mat outImgG(im2.clone());
+  cv::Mat diffImg;
+  cv::absdiff(im2(roi2), im1_trans, diffImg);
+  cv::Mat outImgG;
 
-  warpPerspective(diffImg, outImgG, H, diffImg.size(), cv::WARP_INVERSE_MAP);
+  warpPerspective(diffImg, outImgG, H_rois, footprint.bbox.size(), cv::WARP_INVERSE_MAP);
   
   cv::Mat finThres;
-  cv::Mat finMask;
+  cv::cvtColor(outImgG, finThres, CV_BGR2GRAY);
+
+  //Otsu threshold computed over the overlapping pixels only
+  uchar thres = static_cast<uchar>(ImgProcessing::getFootprintOtsu(finThres, footprint));
+
+  for(int r = 0 ; r < footprint.bbox.height ; r++){
+    const uchar *diff_row = finThres.ptr<uchar>(r) - footprint.bbox.x;
+    uchar *mask_row = mask.ptr<uchar>(footprint.bbox.y + r);
 
-  cv::cvtColor(outImgG, finThres, CV_BGR2GRAY);      
-  cv::threshold(finThres, mask, 30, 255, CV_THRESH_OTSU);
+    for(int c = footprint.spans[r].first ; c < footprint.spans[r].second ; c++)
+      mask_row[c] = (diff_row[c] > thres) ? 255 : 0;
+  }
 }
 
-std::vector<int> ImgChangeDetector::imgFeatDiff(const std::vector<ImgFeature>& new_imgs_feat, const std::vector<ImgFeature>& old_imgs_feat, const std::vector<PtCamCorr>& pts_corr, const std::set<int>& new_imgs_idx, const std::set<int>& old_imgs_idx){
+/**
+Function removes noise from the change mask. Mask is opened and closed with a 3x3 square within the footprint bounding box, then connected components smaller than min_area pixels are erased. Closing can fill pixels, so the numbers of removed and added pixels are returned separately.
+*/
+void ImgChangeDetector::cleanMask(cv::Mat &mask, const ImgFootprint &footprint, int min_area, int &n_removed, int &n_added){
 
-  std::vector<int> out_pts;
-  
-  for(int i = 0 ; i < new_imgs_feat.size() ; i++){
-    PtCamCorr tmp_corr = pts_corr[new_imgs_feat[i].idx];
-    bool add = false;
-  
-    if(tmp_corr.camidx.size()<=new_imgs_idx.size()){
-      add = true;
-      for(int j = 0 ; j < tmp_corr.camidx.size(); j++)
-	if(old_imgs_idx.find(tmp_corr.camidx[j])!=old_imgs_idx.end())
-	  add = false;      
-    }
+  n_removed = 0;
+  n_added = 0;
+
+  if(footprint.empty())
+    return;
+
+  cv::Mat roi = mask(footprint.bbox);
+  cv::Mat before = roi.clone();
 
-    if(add)
-      out_pts.push_back(new_imgs_feat[i].idx);    
+  cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+  cv::morphologyEx(roi, roi, cv::MORPH_OPEN, kernel);
+  cv::morphologyEx(roi, roi, cv::MORPH_CLOSE, kernel);
+
+  //Closing may spill over the footprint boundary
+  for(int r = 0 ; r < footprint.bbox.height ; r++){
+    uchar *mask_row = mask.ptr<uchar>(footprint.bbox.y + r);
+    for(int c = footprint.bbox.x ; c < footprint.spans[r].first ; c++)
+      mask_row[c] = 0;
+    for(int c = std::max(footprint.spans[r].second, footprint.bbox.x) ; c < footprint.bbox.x + footprint.bbox.width ; c++)
+      mask_row[c] = 0;
   }
-    
-  for(int i = 0 ; i < old_imgs_feat.size() ; i++){
-    PtCamCorr tmp_corr = pts_corr[old_imgs_feat[i].idx];
-    bool add = false;    
-
-    if(tmp_corr.camidx.size()<=old_imgs_idx.size()){
-      add = true;
-      for(int j = 0 ; j < tmp_corr.camidx.size(); j++)
-	if(new_imgs_idx.find(tmp_corr.camidx[j])!=new_imgs_idx.end())
-	  add = false;      	  
+
+  SpanMask mask_spans(mask, footprint);
+  MaskComponents components(mask_spans);
+  const std::vector<MaskSpan> &spans = mask_spans.getSpans();
+  const std::vector<int> &labels = components.getSpanLabels();
+
+  std::vector<int> area(components.size(), 0);
+  for(int s = 0 ; s < spans.size() ; s++)
+    area[labels[s]] += spans[s].size();
+
+  for(int s = 0 ; s < spans.size() ; s++)
+    if(area[labels[s]] < min_area)
+      std::fill(mask.ptr<uchar>(spans[s].row) + spans[s].first, mask.ptr<uchar>(spans[s].row) + spans[s].last, 0);
+
+  //Mask holds 0 and 255 only
+  cv::Mat diff;
+  cv::compare(before, roi, diff, cv::CMP_GT);
+  n_removed = cv::countNonZero(diff);
+  cv::compare(roi, before, diff, cv::CMP_GT);
+  n_added = cv::countNonZero(diff);
+}
+
+/**
+Function fuses change masks of one new image computed against several old images. All masks are in the frame of the new image. Pixel is kept if at least min_votes of the masks mark it as changed, pixels covered by fewer than min_votes footprints are dropped. Returns number of changed pixels of the fused mask.
+*/
+int ImgChangeDetector::fuseMasks(const std::vector<cv::Mat>& masks, const std::vector<ImgFootprint>& footprints, int min_votes, cv::Mat& fused){
+
+  fused.release();
+  cv::Size size;
+
+  for(int k = 0 ; k < masks.size() ; k++)
+    if(!masks[k].empty() && !footprints[k].empty()){
+      size = masks[k].size();
+      break;
+    }
+
+  if(size.area() == 0)
+    return 0;
+
+  //Per pixel number of masks marking it as changed
+  cv::Mat votes = cv::Mat::zeros(size, CV_16UC1);
+
+  for(int k = 0 ; k < masks.size() ; k++){
+
+    if(masks[k].empty() || footprints[k].empty() || masks[k].size() != size)
+      continue;
+
+    const ImgFootprint &footprint = footprints[k];
+
+    for(int r = 0 ; r < footprint.bbox.height ; r++){
+      const uchar *mask_row = masks[k].ptr<uchar>(footprint.bbox.y + r);
+      ushort *vote_row = votes.ptr<ushort>(footprint.bbox.y + r);
+
+      for(int c = footprint.spans[r].first ; c < footprint.spans[r].second ; c++)
+	vote_row[c] += (mask_row[c] != 0);
     }
-    
-    if(add)
-      out_pts.push_back(old_imgs_feat[i].idx);
   }
-  
+
+  fused = cv::Mat::zeros(size, CV_8UC1);
+  int n_changed = 0;
+
+  for(int r = 0 ; r < size.height ; r++){
+    const ushort *vote_row = votes.ptr<ushort>(r);
+    uchar *fused_row = fused.ptr<uchar>(r);
+
+    for(int c = 0 ; c < size.width ; c++)
+      if(vote_row[c] > 0 && vote_row[c] >= min_votes){
+	fused_row[c] = 255;
+	n_changed++;
+      }
+  }
+
+  return n_changed;
+}
+
+/**
+Function returns indices of the 3D points seen only by the new images and of the points seen only by the old images. Camera sets are turned into dense membership tables and the features are classified in parallel, the output keeps the order of the features (new ones first).
+*/
+std::vector<int> ImgChangeDetector::imgFeatDiff(const std::vector<ImgFeature>& new_imgs_feat, const std::vector<ImgFeature>& old_imgs_feat, const std::vector<PtCamCorr>& pts_corr, const std::set<int>& new_imgs_idx, const std::set<int>& old_imgs_idx){
+
+  std::vector<unsigned char> in_new, in_old;
+  getCamMembership(new_imgs_idx, in_new);
+  getCamMembership(old_imgs_idx, in_old);
+
+  const int n_new = new_imgs_feat.size();
+  const int n_feat = n_new + old_imgs_feat.size();
+  std::vector<unsigned char> keep(n_feat, 0);
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0 ; i < n_feat ; i++){
+
+    const bool is_new = i < n_new;
+    const std::vector<int> &camidx = pts_corr[is_new ? new_imgs_feat[i].idx : old_imgs_feat[i - n_new].idx].camidx;
+    //Point must not be seen by any camera of the other set
+    const std::vector<unsigned char> &other = is_new ? in_old : in_new;
+
+    if(camidx.size() > (is_new ? new_imgs_idx.size() : old_imgs_idx.size()))
+      continue;
+
+    bool add = true;
+    for(int j = 0 ; j < camidx.size() && add ; j++)
+      if(camidx[j] >= 0 && camidx[j] < other.size() && other[camidx[j]])
+	add = false;
+
+    keep[i] = add;
+  }
+
+  std::vector<int> out_pts;
+
+  for(int i = 0 ; i < n_feat ; i++)
+    if(keep[i])
+      out_pts.push_back(i < n_new ? new_imgs_feat[i].idx : old_imgs_feat[i - n_new].idx);
+
+  return out_pts;
+}
+
+/**
+Function does the same classification as above using visibility bitsets of the points, camera set tests are done word by word.
+*/
+std::vector<int> ImgChangeDetector::imgFeatDiff(const std::vector<ImgFeature>& new_imgs_feat, const std::vector<ImgFeature>& old_imgs_feat, const CamVisibility& visibility, const std::set<int>& new_imgs_idx, const std::set<int>& old_imgs_idx){
+
+  const CamVisibility::CameraSet new_cams = visibility.makeCameraSet(new_imgs_idx);
+  const CamVisibility::CameraSet old_cams = visibility.makeCameraSet(old_imgs_idx);
+
+  const int n_new = new_imgs_feat.size();
+  const int n_feat = n_new + old_imgs_feat.size();
+  std::vector<unsigned char> keep(n_feat, 0);
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0 ; i < n_feat ; i++){
+
+    const bool is_new = i < n_new;
+    const int pt = is_new ? new_imgs_feat[i].idx : old_imgs_feat[i - n_new].idx;
+
+    keep[i] = visibility.count(pt) <= (is_new ? new_imgs_idx.size() : old_imgs_idx.size()) && !visibility.intersects(pt, is_new ? old_cams : new_cams);
+  }
+
+  std::vector<int> out_pts;
+
+  for(int i = 0 ; i < n_feat ; i++)
+    if(keep[i])
+      out_pts.push_back(i < n_new ? new_imgs_feat[i].idx : old_imgs_feat[i - n_new].idx);
+
   return out_pts;
 }
 
+/**
+Function writes a dense table with nonzero entries for the camera indices of the set
+*/
+void ImgChangeDetector::getCamMembership(const std::set<int>& cam_idx, std::vector<unsigned char>& membership){
+
+  membership.assign(cam_idx.empty() ? 0 : std::max(*cam_idx.rbegin() + 1, 0), 0);
+
+  for(std::set<int>::const_iterator it = cam_idx.begin() ; it != cam_idx.end() ; ++it)
+    if(*it >= 0)
+      membership[*it] = 1;
+}
+
 typedef pcl::octree::OctreeContainerPointIndices LeafContainerT;
 typedef pcl::PointXYZRGBA PointT;
+
 /**
-This function uses MRF approach and grapcuts for the energy minimazation problem in order to reduce noise in the output
+   Function writes the neighbor offsets of the MRF neighborhood selected with MRF_CONNECTIVITY: faces (6), faces and edges (18) or the whole 3x3x3 block (26)
 */
-void MeshChangeDetector::energyMinimization(pcl::PointCloud<PointT>::Ptr old_cloud, pcl::PointCloud<PointT>::Ptr chng_mask, double resolution, const double &alpha){
-  
-  CmdIO::callCmd("rm change_mask_MRF.ply");
-  int m = 1000;
-  pcl::PointCloud<PointT>::Ptr copy1 = old_cloud;
-  pcl::PointCloud<PointT>::Ptr copy2 = chng_mask;
+static int getNeighborOffsets(int offsets[MRF_CONNECTIVITY][3]){
+
+  //Largest sum of absolute offsets of a neighbor
+  const int max_dist = MRF_CONNECTIVITY == 6 ? 1 : (MRF_CONNECTIVITY == 18 ? 2 : 3);
+  int count = 0;
+
+  for(int dx = -1 ; dx <= 1 ; dx++)
+    for(int dy = -1 ; dy <= 1 ; dy++)
+      for(int dz = -1 ; dz <= 1 ; dz++){
+	const int dist = std::abs(dx) + std::abs(dy) + std::abs(dz);
+	if(dist == 0 || dist > max_dist)
+	  continue;
+	offsets[count][0] = dx;
+	offsets[count][1] = dy;
+	offsets[count][2] = dz;
+	count++;
+      }
 
-  //Binarize input point clouds
-  PclProcessing::changeCloudColor(*old_cloud, 255, 255, 255);
-  PclProcessing::changeCloudColor(*chng_mask, 255, 0, 0);
+  return count;
+}
 
-  //Merge input point clouds
-  pcl::PointCloud<PointT>::Ptr merged_cloud(new pcl::PointCloud<PointT>);
-  pcl::PointCloud<PointT>::Ptr merged_copy(new pcl::PointCloud<PointT>);
-  *merged_cloud = (*old_cloud)+(*chng_mask);
-  *merged_copy = (*copy1)+(*copy2);
+/**
+   Function loads the collected MRF edges and terminal weights into the solver, computes the minimum cut and marks leaves on the sink side. node_ids maps leaves to nodes of the solver, leaf indices are the nodes when it is empty.
+*/
+template <typename GraphT>
+static void solveMrf(GraphT &g, const std::vector<int> &node_ids, const std::vector<MrfLeaf> &leaves, std::vector<MrfEdgeBuffer> &edge_buffers, double alpha, int64 t_graph, std::vector<unsigned char> &is_sink){
 
-  //Map connecting leaf indeces with their octree key
-  std::map<std::string, int> map_leafs;
+  const int no_of_nodes = leaves.size();
 
-  //Create octree
-  MyOctree octree(resolution);
-  octree.setInputCloud (merged_cloud);
-  octree.addPointsFromInputCloud();
+  //Bulk load edges of every thread, memory of a buffer is released once it is in the graph
+  for(int t = 0 ; t < edge_buffers.size() ; t++){
+    MrfEdgeBuffer &buffer = edge_buffers[t];
 
-  LeafContainerT *leaf_container;
-  typename MyOctree::LeafNodeIterator leaf_itr;
+    if(!node_ids.empty())
+      for(int e = 0 ; e < buffer.size() ; e++){
+	buffer.from[e] = node_ids[buffer.from[e]];
+	buffer.to[e] = node_ids[buffer.to[e]];
+      }
 
-  int no_of_nodes = octree.getLeafCount();
-  int avg_chng_pts_no = chng_mask->points.size()/no_of_nodes;
-  int avg_white_pts = old_cloud->points.size()/no_of_nodes;
+    if(buffer.size() > 0)
+      g.add_edges(buffer.size(), &buffer.from[0], &buffer.to[0], &buffer.cap[0], &buffer.rev_cap[0]);
+    MrfEdgeBuffer().swap(buffer);
+  }
 
-  //Create graphcut solver instance
-  typedef Graph<int,int,int> GraphType;
-  GraphType *g = new GraphType(/*estimated # of nodes*/ no_of_nodes, /*estimated # of edges*/ no_of_nodes*26); 
+  //Add SOURCE/SINK weights for every node
+  for(int count = 0 ; count < no_of_nodes ; count++)
+    g.add_tweights(node_ids.empty() ? count : node_ids[count], 1, alpha*leaves[count].red_count);
 
-  int count = 0;
+  std::cout<<"Graph construction time: "<<(cv::getTickCount() - t_graph)/cv::getTickFrequency()<<" s"<<std::endl;
+
+  int64 t_solve = cv::getTickCount();
+  g.maxflow();
+  std::cout<<"Max-flow time: "<<(cv::getTickCount() - t_solve)/cv::getTickFrequency()<<" s"<<std::endl;
 
-  //Iterate through octree to fill the map_leafs structure and add nodes to the solver
-  for(leaf_itr = octree.leaf_begin(); leaf_itr!=octree.leaf_end() ; ++leaf_itr){
+  is_sink.resize(no_of_nodes);
+  for(int count = 0 ; count < no_of_nodes ; count++)
+    is_sink[count] = g.what_segment(node_ids.empty() ? count : node_ids[count]) == GraphT::SINK;
+}
+
+/**
+   Function collects the leaves of the octree sorted by morton code with their statistics, and the MRF edges between neighboring leaves into one buffer per thread
+*/
+static void collectMrf(MyOctree &octree, const std::vector<unsigned char> &labels, std::vector<MrfLeaf> &leaves, std::vector<MrfEdgeBuffer> &edge_buffers){
+
+  int64 t_edges = cv::getTickCount();
+
+  int no_of_nodes = octree.getLeafCount();
 
-    pcl::octree::OctreeKey key_arg = leaf_itr.getCurrentOctreeKey();
-    std::ostringstream ss;
-    ss << key_arg.x << "-"<< key_arg.y<<"-"<<key_arg.z;
-    map_leafs[ss.str()]=count;
-    g->add_node();
-    count++;
+  //Collect leaves once, graph node of a leaf is its position in morton order
+  leaves.clear();
+  leaves.reserve(no_of_nodes);
+
+  for(MyOctree::LeafNodeIterator leaf_itr = octree.leaf_begin(); leaf_itr!=octree.leaf_end() ; ++leaf_itr){
+
+    const pcl::octree::OctreeKey &key_arg = leaf_itr.getCurrentOctreeKey();
+    MrfLeaf leaf;
+    leaf.container = &(leaf_itr.getLeafContainer());
+    leaf.x = key_arg.x;
+    leaf.y = key_arg.y;
+    leaf.z = key_arg.z;
+    leaf.morton = LeafKeyIndex::morton(key_arg.x, key_arg.y, key_arg.z);
+    leaves.push_back(leaf);
   }
-  
-  count = 0;
-
-  //Iterate through octree leaves/nodes creating the graph for solver
-  for(leaf_itr = octree.leaf_begin(); leaf_itr!=octree.leaf_end() ; ++leaf_itr){
-
-    int red_no = 0;   
-    std::vector<int> pts_idx;    
-    
-    //Get octree key for current node
-    pcl::octree::OctreeKey key_arg = leaf_itr.getCurrentOctreeKey ();
-    
-    //Get leaf container for current node
-    leaf_container = &(leaf_itr.getLeafContainer());
-    
-    //Get indices of points belonging to the node
-    leaf_container->getPointIndices(pts_idx);
-    
-    //Count the number of change(red) points
-    red_no = getRedCount(pts_idx, *merged_cloud);
-    
-    //Get octree keys of neighbors and their leafcontainers
-    std::vector<LeafContainerT*> tmp_vec;
-    std::vector<pcl::octree::OctreeKey> tmp_vec2;
-    octree.findNeighbors(key_arg, tmp_vec);    
-    octree.findNeighbors(key_arg, tmp_vec2);
-  
-    int weight_count = 0;
-    
-    //Iterate through node neighbors
-    for(int i = 0 ; i < tmp_vec.size(); i ++){
-    
-      //Get current neighbor points indices
-      std::vector<int> neigh_idx;
-      tmp_vec[i]->getPointIndices(neigh_idx);
-      
-      //Count the number of change(red) points in the neighbor node
-      int red_n_no = getRedCount(neigh_idx, *merged_cloud);
-      weight_count+=red_n_no;
-      
-      //Get graph index of the neighbor node using the map
-      pcl::octree::OctreeKey neigh_key = tmp_vec2[i];
-      std::ostringstream ss;
-      ss << neigh_key.x << "-"<< neigh_key.y<<"-"<<neigh_key.z;
-      int neigh_idx_single = map_leafs[ss.str()];
 
-      int coeff = avg_chng_pts_no;
-      int coeff2 = abs(red_no - red_n_no);
+  std::sort(leaves.begin(), leaves.end());
+  no_of_nodes = leaves.size();
+
+  //Index connecting graph nodes with their octree key
+  LeafKeyIndex leaf_index(no_of_nodes);
 
-      if(neigh_idx_single!=count){
-	int result = avg_chng_pts_no;
-	double exp_result = static_cast<double>(m)*static_cast<double>(exp(-(abs(red_no-red_n_no))));
-	result = static_cast<int>(exp_result);
+  //Count the number of change(red) points of every leaf
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(int i = 0 ; i < no_of_nodes ; i++){
+
+    std::vector<int> pts_idx;
+    leaves[i].container->getPointIndices(pts_idx);
+    leaves[i].red_count = MeshChangeDetector::getRedCount(pts_idx, labels);
+    leaves[i].total_count = pts_idx.size();
+  }
+
+  for(int i = 0 ; i < no_of_nodes ; i++)
+    leaf_index.insert(leaves[i].x, leaves[i].y, leaves[i].z, i);
+
+  int offsets[MRF_CONNECTIVITY][3];
+  const int no_of_offsets = getNeighborOffsets(offsets);
+
+  //Every thread collects edges of a contiguous range of leaves, buffers appended in thread order give the serial edge order
+  int no_of_threads = 1;
+#ifdef _OPENMP
+  no_of_threads = omp_get_max_threads();
+#endif
+  edge_buffers.clear();
+  edge_buffers.resize(no_of_threads);
+
+#pragma omp parallel num_threads(no_of_threads)
+  {
+    int thread_id = 0, team_size = 1;
+#ifdef _OPENMP
+    thread_id = omp_get_thread_num();
+    team_size = omp_get_num_threads();
+#endif
+    const int first = static_cast<long long>(no_of_nodes)*thread_id/team_size;
+    const int last = static_cast<long long>(no_of_nodes)*(thread_id + 1)/team_size;
+    MrfEdgeBuffer &buffer = edge_buffers[thread_id];
+
+    //Iterate through leaves collecting edges for solver
+    for(int count = first ; count < last ; count++){
+
+      const MrfLeaf &leaf = leaves[count];
+      const int red_no = leaf.red_count;
+
+      //Iterate through node neighbors
+      for(int k = 0 ; k < no_of_offsets ; k++){
+
+	const long long nx = static_cast<long long>(leaf.x) + offsets[k][0];
+	const long long ny = static_cast<long long>(leaf.y) + offsets[k][1];
+	const long long nz = static_cast<long long>(leaf.z) + offsets[k][2];
+	if(nx < 0 || ny < 0 || nz < 0)
+	  continue;
+
+	//Get graph index of the neighbor node using the index
+	int neigh_idx_single = leaf_index.find(static_cast<unsigned int>(nx), static_cast<unsigned int>(ny), static_cast<unsigned int>(nz));
+	if(neigh_idx_single < 0)
+	  continue;
+
+	int red_n_no = leaves[neigh_idx_single].red_count;
 
 	if(red_no>0 && red_n_no>0)	  
-	  g->add_edge(count, neigh_idx_single, 1 , 1);
+	  buffer.add(count, neigh_idx_single, 1 , 1);
 	else
 	  if(red_no==0 && red_n_no>0)
-	    g->add_edge(count, neigh_idx_single, 1 , 0);
+	    buffer.add(count, neigh_idx_single, 1 , 0);
 	  else
 	    if(red_no>0 && red_n_no==0)
-	      g->add_edge(count,neigh_idx_single, 0 , 1);
+	      buffer.add(count,neigh_idx_single, 0 , 1);
 	    else
-	      g->add_edge(count, neigh_idx_single, 1, 1);
-	
-	
-	/*	
-	if(red_no!=red_n_no){
-	  if(red_no == 0 || red_n_no == 0)
-	    g->add_edge(count, neigh_idx_single, 0 , 0);
-	  else
-	    g->add_edge(count, neigh_idx_single, red_n_no, red_no);
-	}
-	else
-	  if(red_no>0)
-	    g->add_edge(count,neigh_idx_single, red_n_no, red_no);
-	  else
-	    g->add_edge(count, neigh_idx_single, avg_chng_pts_no, avg_chng_pts_no);
-	*/
+	      buffer.add(count, neigh_idx_single, 1, 1);
       }
     }
-    //Add SOURCE/SINK weights for current node
+  }
+
+  std::cout<<"Edge collection time: "<<(cv::getTickCount() - t_edges)/cv::getTickFrequency()<<" s ("<<no_of_threads<<" threads)"<<std::endl;
+}
+
+/**
+   Function computes the minimum cut of the collected MRF with the selected solver and marks leaves on the sink side, the edge buffers are consumed. The serial solver runs on the implicit lattice when it is dense enough.
+*/
+static void cutMrf(const std::vector<MrfLeaf> &leaves, std::vector<MrfEdgeBuffer> &edge_buffers, double alpha, int solver, int64 t_graph, std::vector<unsigned char> &is_sink){
 
-    //    g->add_tweights(count, avg_chng_pts_no , red_no);
-    g->add_tweights(count, 1, alpha*red_no);
+  const int no_of_nodes = leaves.size();
 
-    count++;
+  int no_of_edges = 0;
+  for(int t = 0 ; t < edge_buffers.size() ; t++)
+    no_of_edges += edge_buffers[t].size();
+
+  if(solver == MRF_PARALLEL){
+
+    int no_of_threads = 1;
+#ifdef _OPENMP
+    no_of_threads = omp_get_max_threads();
+#endif
+    std::cout<<"MRF solver: parallel push-relabel ("<<no_of_threads<<" threads)"<<std::endl;
+
+    ParallelGraph<short,int,int> g(no_of_nodes, no_of_edges);
+    g.add_node(no_of_nodes);
+
+    solveMrf(g, std::vector<int>(), leaves, edge_buffers, alpha, t_graph, is_sink);
+    return;
+  }
+
+  //Bounding box of the leaf keys, a dense enough MRF is solved on the implicit lattice
+  unsigned int key_min[3] = {UINT_MAX, UINT_MAX, UINT_MAX}, key_max[3] = {0, 0, 0};
+  for(int i = 0 ; i < no_of_nodes ; i++){
+    const unsigned int key[3] = {leaves[i].x, leaves[i].y, leaves[i].z};
+    for(int d = 0 ; d < 3 ; d++){
+      key_min[d] = std::min(key_min[d], key[d]);
+      key_max[d] = std::max(key_max[d], key[d]);
+    }
+  }
+
+  int lattice_dims[3];
+  double lattice_cells = 1;
+  for(int d = 0 ; d < 3 ; d++){
+    lattice_dims[d] = no_of_nodes > 0 ? key_max[d] - key_min[d] + 1 : 1;
+    //Lattice is padded to whole blocks of 4 cells
+    lattice_cells *= (lattice_dims[d] + 3)/4*4;
+  }
+
+  if(lattice_cells <= static_cast<double>(MeshChangeDetector::MAX_LATTICE_FILL)*no_of_nodes && lattice_cells < INT_MAX){
+
+    std::cout<<"MRF solver: lattice "<<lattice_dims[0]<<"x"<<lattice_dims[1]<<"x"<<lattice_dims[2]<<std::endl;
+
+    GridGraph<short,int,int> g(lattice_dims[0], lattice_dims[1], lattice_dims[2], MRF_CONNECTIVITY);
+
+    std::vector<int> node_ids(no_of_nodes);
+    for(int i = 0 ; i < no_of_nodes ; i++)
+      node_ids[i] = g.get_node_id(leaves[i].x - key_min[0], leaves[i].y - key_min[1], leaves[i].z - key_min[2]);
+
+    solveMrf(g, node_ids, leaves, edge_buffers, alpha, t_graph, is_sink);
+    return;
   }
 
+  std::cout<<"MRF solver: graph"<<std::endl;
+
+  //Create graphcut solver instance
+  Graph<short,int,int> g(/*# of nodes*/ no_of_nodes, /*# of edges*/ no_of_edges);
+  g.add_node(no_of_nodes);
+
+  solveMrf(g, std::vector<int>(), leaves, edge_buffers, alpha, t_graph, is_sink);
+}
+
+/**
+Function copies positions of both clouds into one cloud and labels the points for the MRF: old points get 0, change points their votes (at least 1, saturated at 255). Change points without a vote count once.
+*/
+void MeshChangeDetector::getMrfLabels(pcl::PointCloud<PointT>::Ptr old_cloud, pcl::PointCloud<PointT>::Ptr chng_mask, const std::vector<int> &chng_votes, pcl::PointCloud<pcl::PointXYZ>::Ptr positions, std::vector<unsigned char> &labels){
+
+  const int n_old = old_cloud->points.size();
+  const int n_chng = chng_mask->points.size();
+
+  positions->points.resize(n_old + n_chng);
+  positions->width = n_old + n_chng;
+  positions->height = 1;
+  positions->is_dense = old_cloud->is_dense && chng_mask->is_dense;
+
+  labels.assign(n_old + n_chng, 0);
+
+  for(int i = 0 ; i < n_old ; i++){
+    const PointT &pt = old_cloud->points[i];
+    positions->points[i] = pcl::PointXYZ(pt.x, pt.y, pt.z);
+  }
+
+  for(int i = 0 ; i < n_chng ; i++){
+    const PointT &pt = chng_mask->points[i];
+    positions->points[n_old + i] = pcl::PointXYZ(pt.x, pt.y, pt.z);
+    labels[n_old + i] = i < chng_votes.size() ? std::min(std::max(chng_votes[i], 1), 255) : 1;
+  }
+}
+
+/**
+This function uses MRF approach and grapcuts for the energy minimazation problem in order to reduce noise in the output. Input clouds are not modified, their positions are copied into one cloud and change points are labelled by their votes (see MeshIO::getChngMaskVotes).
+*/
+void MeshChangeDetector::energyMinimization(pcl::PointCloud<PointT>::Ptr old_cloud, pcl::PointCloud<PointT>::Ptr chng_mask, const std::vector<int> &chng_votes, double resolution, const double &alpha, int solver){
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr positions(new pcl::PointCloud<pcl::PointXYZ>);
+  std::vector<unsigned char> labels;
+  getMrfLabels(old_cloud, chng_mask, chng_votes, positions, labels);
+
+  energyMinimization(positions, labels, resolution, alpha, solver);
+}
+
+/**
+This function runs the MRF energy minimization on point positions with a label per point: 0 for unchanged points, number of votes for change points. solver is one of mrf_solver.
+*/
+void MeshChangeDetector::energyMinimization(pcl::PointCloud<pcl::PointXYZ>::Ptr positions, const std::vector<unsigned char> &labels, double resolution, const double &alpha, int solver){
+  
+  CmdIO::callCmd("rm change_mask_MRF.ply");
+
+  if(labels.size() != positions->points.size()){
+    std::cout<<"Number of labels does not match the number of points"<<std::endl;
+    return;
+  }
+
+  //Create octree
+  MyOctree octree(resolution);
+  octree.setInputCloud (positions);
+  octree.addPointsFromInputCloud();
+
+  int64 t_graph = cv::getTickCount();
+
+  std::vector<MrfLeaf> leaves;
+  std::vector<MrfEdgeBuffer> edge_buffers;
+  collectMrf(octree, labels, leaves, edge_buffers);
+
+  const int no_of_nodes = leaves.size();
+
+  std::vector<unsigned char> is_sink;
+  cutMrf(leaves, edge_buffers, alpha, solver, t_graph, is_sink);
+
   std::vector<std::vector<vcg::Point3f> > out_points;
   std::vector<vcg::Point3f> tmp_vcg_pts;
 
-  count = 0;
-  g->maxflow();
-
-  for(leaf_itr = octree.leaf_begin(); leaf_itr!=octree.leaf_end() ; ++leaf_itr){
-    if(g->what_segment(count) == GraphType::SINK){      
+  for(int count = 0 ; count < no_of_nodes ; count++){
+    if(is_sink[count]){      
       std::vector<int> pts_idx;
-      leaf_container = &(leaf_itr.getLeafContainer());
-      leaf_container->getPointIndices(pts_idx);
+      leaves[count].container->getPointIndices(pts_idx);
       
       for(int i = 0 ; i<pts_idx.size();i++)
-	tmp_vcg_pts.push_back(PclProcessing::pcl2vcgPt(merged_cloud->points[pts_idx[i]]));
+	tmp_vcg_pts.push_back(PclProcessing::pcl2vcgPt(positions->points[pts_idx[i]]));
     }
-    count++;
   }
   
-  std::cout<<"Old mask size: "<<chng_mask->points.size()<<" New mask size: "<<tmp_vcg_pts.size()<<std::endl;
+  std::cout<<"Old mask size: "<<labels.size() - std::count(labels.begin(), labels.end(), 0)<<" New mask size: "<<tmp_vcg_pts.size()<<std::endl;
 
   out_points.push_back(tmp_vcg_pts);
   std::vector<vcg::Color4b> pts_color(0);
   MeshIO::saveChngMask3d(out_points, pts_color, "change_mask_MRF.ply");
-
-  delete g;
 } 
 
-int MeshChangeDetector::getRedCount(const std::vector<int> &pts_idx, const pcl::PointCloud<pcl::PointXYZRGBA>& in_cloud){
+/**
+   Function builds the MRF of the clouds once and compares the Boykov-Kolmogorov graph solver with the parallel push-relabel solver on 1 to 32 threads. Both compute a minimum cut with the same sink side, leaves labelled differently are reported as mismatches. Times cover creating the solver, loading the edges and the max-flow, since ParallelGraph builds its adjacency arrays in maxflow() while Graph builds its arcs as edges are added.
+*/
+void MeshChangeDetector::benchmarkMaxflow(pcl::PointCloud<PointT>::Ptr old_cloud, pcl::PointCloud<PointT>::Ptr chng_mask, const std::vector<int> &chng_votes, double resolution, const double &alpha){
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr positions(new pcl::PointCloud<pcl::PointXYZ>);
+  std::vector<unsigned char> labels;
+  getMrfLabels(old_cloud, chng_mask, chng_votes, positions, labels);
+
+  MyOctree octree(resolution);
+  octree.setInputCloud (positions);
+  octree.addPointsFromInputCloud();
+
+  std::vector<MrfLeaf> leaves;
+  std::vector<MrfEdgeBuffer> edge_buffers;
+  collectMrf(octree, labels, leaves, edge_buffers);
+
+  int no_of_edges = 0;
+  for(int t = 0 ; t < edge_buffers.size() ; t++)
+    no_of_edges += edge_buffers[t].size();
+
+  std::cout<<"MRF nodes: "<<leaves.size()<<", edges: "<<no_of_edges<<std::endl;
+
+  //Solvers consume the edge buffers, every run gets a copy
+  std::vector<MrfEdgeBuffer> run_buffers(edge_buffers);
+  std::vector<unsigned char> ref_sink;
+
+  //Reference is always the Boykov-Kolmogorov graph, never the lattice solver
+  int64 t_start = cv::getTickCount();
+  {
+    Graph<short,int,int> g(leaves.size(), no_of_edges);
+    g.add_node(leaves.size());
+    solveMrf(g, std::vector<int>(), leaves, run_buffers, alpha, t_start, ref_sink);
+  }
+  double t_ref = (cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+  std::cout<<"Serial max-flow (graph): "<<t_ref<<" s, sink leaves: "<<std::count(ref_sink.begin(), ref_sink.end(), 1)<<std::endl;
+
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+
+  for(int threads = 1 ; threads <= 32 ; threads *= 2){
+
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    std::vector<unsigned char> is_sink;
+    run_buffers = edge_buffers;
+    t_start = cv::getTickCount();
+    cutMrf(leaves, run_buffers, alpha, MRF_PARALLEL, t_start, is_sink);
+    double t_cut = (cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+    int mismatches = 0;
+    for(int i = 0 ; i < is_sink.size() ; i++)
+      if(is_sink[i] != ref_sink[i])
+	mismatches++;
+
+    std::cout<<"Parallel max-flow, "<<threads<<" threads: "<<t_cut<<" s, speedup "<<t_ref/t_cut
+	     <<", mismatches: "<<mismatches<<std::endl;
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(max_threads);
+#endif
+}
+
+/**
+Function returns the votes of change points among the points, labels of unchanged points are 0
+*/
+int MeshChangeDetector::getRedCount(const std::vector<int> &pts_idx, const std::vector<unsigned char> &labels){
   
   int count = 0;
   for(int i = 0 ; i<pts_idx.size(); i++)
-    if(in_cloud.points[pts_idx[i]].getRGBVector3i()[1]==0){
-      count++;
-    }  
+    count += labels[pts_idx[i]];
   return count;
 }
 void MyOctree::findNeighbors(const pcl::octree::OctreeKey& key_arg, std::vector<pcl::octree::OctreeKey>& out_vec){
@@ -3,6 +3,7 @@
 
 #include<vcg/space/point3.h>
 #include "../common/common.hpp"
+#include "../util/utilIO.hpp"
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include <pcl/point_types.h>
@@ -13,6 +14,12 @@
 #include <pcl/octree/octree_impl.h>
 
 #include <set>
+
+class CamVisibility;
+
+//Max-flow solvers of the voxel MRF: serial Boykov-Kolmogorov (on the lattice when it is dense enough) or multi-threaded push-relabel, index of the GUI combo box
+enum mrf_solver{MRF_SERIAL, MRF_PARALLEL};
+
 class ChangeDetector{
 
 protected:
@@ -40,7 +47,12 @@ public:
   cv::Mat getImageDifference(cv::Mat, cv::Mat);
   std::vector<vcg::Point3f> projChngMask(cv::Mat, vcg::Shot<float>);
   static void imgDiffThres(cv::Mat, cv::Mat, cv::Mat, cv::Mat&);
+  static void imgDiffThres(cv::Mat, cv::Mat, cv::Mat, cv::Mat&, ImgFootprint&);
+  static void cleanMask(cv::Mat&, const ImgFootprint&, int, int&, int&);
+  static int fuseMasks(const std::vector<cv::Mat>&, const std::vector<ImgFootprint>&, int, cv::Mat&);
   static std::vector<int> imgFeatDiff(const std::vector<ImgFeature>&, const std::vector<ImgFeature>&, const std::vector<PtCamCorr>&, const std::set<int>&, const std::set<int>&);
+  static std::vector<int> imgFeatDiff(const std::vector<ImgFeature>&, const std::vector<ImgFeature>&, const CamVisibility&, const std::set<int>&, const std::set<int>&);
+  static void getCamMembership(const std::set<int>&, std::vector<unsigned char>&);
   static std::vector<int> filtColor(const std::vector<int>&, const std::vector<PtCamCorr>&, const std::vector<std::string>&);
 };
 
@@ -54,19 +66,74 @@ MeshChangeDetector() : ChangeDetector(){};
   std::vector<vcg::Point3f> getChangeMap(){
   }
   
-  static void energyMinimization(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, double, const double&);
+  static void energyMinimization(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, const std::vector<int>&, double, const double&, int solver = MRF_SERIAL);
+  static void energyMinimization(pcl::PointCloud<pcl::PointXYZ>::Ptr, const std::vector<unsigned char>&, double, const double&, int solver = MRF_SERIAL);
+  static void benchmarkMaxflow(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, const std::vector<int>&, double, const double&);
 
-static int getRedCount(const std::vector<int>&, const pcl::PointCloud<pcl::PointXYZRGBA>&);
+  //Largest ratio of lattice cells to occupied leaves for which the MRF is solved on the voxel lattice
+  static const int MAX_LATTICE_FILL = 8;
+
+static int getRedCount(const std::vector<int>&, const std::vector<unsigned char>&);
+static void getMrfLabels(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, const std::vector<int>&, pcl::PointCloud<pcl::PointXYZ>::Ptr, std::vector<unsigned char>&);
   
 };
 
 typedef pcl::octree::OctreeContainerPointIndices LeafContainerT;
 typedef pcl::PointXYZRGBA PointT;
-class MyOctree : public pcl::octree::OctreePointCloudSearch<PointT>{
+
+//Neighborhood of the voxel MRF in energyMinimization: 6, 18 or 26 connected
+#ifndef MRF_CONNECTIVITY
+#define MRF_CONNECTIVITY 26
+#endif
+
+#if MRF_CONNECTIVITY != 6 && MRF_CONNECTIVITY != 18 && MRF_CONNECTIVITY != 26
+#error "MRF_CONNECTIVITY must be 6, 18 or 26"
+#endif
+
+/**
+   Octree leaf of the voxel MRF with statistics computed once. Leaves are sorted by morton code of their key, so neighboring voxels get close graph nodes.
+*/
+struct MrfLeaf{
+  LeafContainerT *container;
+  unsigned int x, y, z;
+  unsigned long long morton;
+  //Votes of change points and number of all points in the leaf
+  int red_count;
+  int total_count;
+
+  bool operator<(const MrfLeaf &other) const {return morton < other.morton;}
+};
+
+/**
+   Edges of the voxel MRF collected by one thread before they are loaded into the graph
+*/
+struct MrfEdgeBuffer{
+  std::vector<int> from, to;
+  //Capacities of the MRF are small, 16 bits fit both graph solvers
+  std::vector<short> cap, rev_cap;
+
+  void add(int i, int j, short c, short rev_c){
+    from.push_back(i);
+    to.push_back(j);
+    cap.push_back(c);
+    rev_cap.push_back(rev_c);
+  }
+
+  int size() const {return from.size();}
+
+  void swap(MrfEdgeBuffer &other){
+    from.swap(other.from);
+    to.swap(other.to);
+    cap.swap(other.cap);
+    rev_cap.swap(other.rev_cap);
+  }
+};
+
+class MyOctree : public pcl::octree::OctreePointCloudSearch<pcl::PointXYZ>{
 
 public:
 
-MyOctree (const double resolution) : pcl::octree::OctreePointCloudSearch<PointT> (resolution)
+MyOctree (const double resolution) : pcl::octree::OctreePointCloudSearch<pcl::PointXYZ> (resolution)
 {
 }
 
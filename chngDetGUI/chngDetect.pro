@@ -7,6 +7,14 @@
 QT       += core gui
 
 CONFIG += console
+
+QMAKE_CXXFLAGS += -fopenmp
+# qmake CONFIG+=native_arch tunes for the build host (AVX/AVX2 paths)
+native_arch {
+    QMAKE_CXXFLAGS += -march=native
+}
+LIBS += -fopenmp
+
 TARGET = chngDetect
 TEMPLATE = app
 
@@ -60,11 +68,26 @@ SOURCES += main.cpp\
     /home/bheliom/develop/masterTh/util/utilIO.cpp \
     /home/bheliom/develop/masterTh/util/pbaUtil.cpp \
     /home/bheliom/develop/masterTh/util/meshProcess.cpp \
+    /home/bheliom/develop/masterTh/util/spanMask.cpp \
+    /home/bheliom/develop/masterTh/util/occupancyGrid.cpp \
+    /home/bheliom/develop/masterTh/util/rayCaster.cpp \
+    /home/bheliom/develop/masterTh/util/distanceField.cpp \
+    /home/bheliom/develop/masterTh/util/meshGeometry.cpp \
+    /home/bheliom/develop/masterTh/util/meshBVH.cpp \
+    /home/bheliom/develop/masterTh/util/depthBuffer.cpp \
+    /home/bheliom/develop/masterTh/util/triangulator.cpp \
+    /home/bheliom/develop/masterTh/util/voxelAccumulator.cpp \
+    /home/bheliom/develop/masterTh/util/maskComponents.cpp \
+    /home/bheliom/develop/masterTh/util/rayGenerator.cpp \
+    /home/bheliom/develop/masterTh/util/camVisibility.cpp \
+    /home/bheliom/develop/masterTh/util/incrementalGrouping.cpp \
     /home/bheliom/develop/masterTh/common/common.cpp \
     /home/bheliom/develop/masterTh/chngDet/chngDet.cpp \
     /home/bheliom/develop/masterTh/pipelines.cpp \
     /home/bheliom/develop/masterTh/maxflowLib/graph.cpp \
     /home/bheliom/develop/masterTh/maxflowLib/maxflow.cpp \
+    /home/bheliom/develop/masterTh/maxflowLib/gridGraph.cpp \
+    /home/bheliom/develop/masterTh/maxflowLib/parallelGraph.cpp \
     /usr/include/wrap/ply/plylib.cpp \
 
 HEADERS  += chngdetect.h \
@@ -75,9 +98,26 @@ HEADERS  += chngdetect.h \
     /home/bheliom/develop/masterTh/util/pbaUtil.h \
     /home/bheliom/develop/masterTh/util/pbaDataInterface.h \
     /home/bheliom/develop/masterTh/util/meshProcess.hpp \
+    /home/bheliom/develop/masterTh/util/spanMask.hpp \
+    /home/bheliom/develop/masterTh/util/occupancyGrid.hpp \
+    /home/bheliom/develop/masterTh/util/rayCaster.hpp \
+    /home/bheliom/develop/masterTh/util/distanceField.hpp \
+    /home/bheliom/develop/masterTh/util/meshGeometry.hpp \
+    /home/bheliom/develop/masterTh/util/meshBVH.hpp \
+    /home/bheliom/develop/masterTh/util/depthBuffer.hpp \
+    /home/bheliom/develop/masterTh/util/triangulator.hpp \
+    /home/bheliom/develop/masterTh/util/atomicBitset.hpp \
+    /home/bheliom/develop/masterTh/util/voxelAccumulator.hpp \
+    /home/bheliom/develop/masterTh/util/maskComponents.hpp \
+    /home/bheliom/develop/masterTh/util/rayGenerator.hpp \
+    /home/bheliom/develop/masterTh/util/camVisibility.hpp \
+    /home/bheliom/develop/masterTh/util/incrementalGrouping.hpp \
+    /home/bheliom/develop/masterTh/util/leafKeyIndex.hpp \
     /home/bheliom/develop/masterTh/common/globVariables.hpp \
     /home/bheliom/develop/masterTh/common/common.hpp \
     /home/bheliom/develop/masterTh/pipelines.hpp \
-    /home/bheliom/develop/masterTh/maxflowLib/graph.h
+    /home/bheliom/develop/masterTh/maxflowLib/graph.h \
+    /home/bheliom/develop/masterTh/maxflowLib/gridGraph.h \
+    /home/bheliom/develop/masterTh/maxflowLib/parallelGraph.h
 
 FORMS    += chngdetect.ui
@@ -31,6 +31,16 @@ bool model_load = false;
 bool change_det = false;
 int click_count = 0;
 enum detection_technique{POINT_GROUPING, IMG_DIFFERENCE, PSA};
+
+// Projection techniques working on the voxelized old model
+static bool usesVoxelGrid(int proj_method){
+    return proj_method == RAY_SHOOTING || proj_method == SPHERE_TRACING || proj_method == COMPONENT_RAY_SHOOTING || proj_method == ADAPTIVE_RAY_SHOOTING;
+}
+
+// Projection techniques intersecting rays with the old model
+static bool usesOldModel(int proj_method){
+    return usesVoxelGrid(proj_method) || proj_method == MESH_RAYCAST || proj_method == MESH_RAYCAST_VERTEX || proj_method == DEPTH_BUFFER;
+}
 int curr_det_tech = 0;
 double resolution = 0.1;
 double resolutionVox = 0.1;
@@ -157,6 +167,9 @@ void chngDetect::on_pushButton_3_clicked()
 {
     input_strings[MESH] = "old_model.ply";
     input_strings[CHANGEMASK] = "change_mask.ply";
+    stringstream solver;
+    solver << ui->comboBox_3->currentIndex();
+    input_strings[MRFSOLVER] = solver.str();
     energyMin(input_strings, resolution, alpha);
     pviz.removePointCloud("change_mask_mrf");
 
@@ -194,15 +207,26 @@ void chngDetect::on_pushButton_6_clicked()
 
  switch(curr_det_tech){
     case POINT_GROUPING:
+        {
+        stringstream grouping_mode;
+        grouping_mode << (ui->checkBox->isChecked() ? INCREMENTAL_GROUPING : BATCH_GROUPING);
+        input_strings[FEATGROUPING] = grouping_mode.str();
         pipelineCorrespondences(input_strings, ui->spinBox_2->value(), camera_cloud, view_points);
         break;
+        }
     case IMG_DIFFERENCE:
         {
-        if(ui->comboBox->currentIndex()==1 && (input_strings[MESH].compare("")==0))
+        if(usesOldModel(ui->comboBox->currentIndex()) && (input_strings[MESH].compare("")==0))
         {
-            ui->plainTextEdit->appendPlainText("Ray shooting requires old model ply file!");
+            ui->plainTextEdit->appendPlainText("Ray shooting, sphere tracing, mesh ray casting and depth buffer require old model ply file!");
             return;
         }
+        stringstream fuse_votes;
+        fuse_votes << ui->spinBox_3->value();
+        input_strings[FUSEVOTES] = fuse_votes.str();
+        stringstream min_area;
+        min_area << ui->spinBox_4->value();
+        input_strings[MINAREA] = min_area.str();
         pipelineImgDifference(input_strings, ui->spinBox_2->value(), camera_cloud, view_points, ui->comboBox->currentIndex(),resolutionVox );
         break;
         }
@@ -274,7 +298,7 @@ void chngDetect::on_comboBox_2_currentIndexChanged(int index)
 
     if(curr_det_tech==IMG_DIFFERENCE){
         ui->comboBox->setEnabled(true);
-        if(ui->comboBox->currentIndex()==1)
+        if(usesVoxelGrid(ui->comboBox->currentIndex()))
              ui->lineEdit_2->setEnabled(true);
     }
     else
@@ -303,7 +327,7 @@ void chngDetect::on_lineEdit_editingFinished()
 
 void chngDetect::on_comboBox_currentIndexChanged(int index)
 {
-    if(index==1)
+    if(usesVoxelGrid(index))
          ui->lineEdit_2->setEnabled(true);
     else
          ui->lineEdit_2->setDisabled(true);
@@ -18,7 +18,7 @@ struct MyUsedTypes : public vcg::UsedTypes<vcg::Use<MyVertex>   ::AsVertexType,
   vcg::Use<MyEdge>     ::AsEdgeType,
   vcg::Use<MyFace>     ::AsFaceType>{};
   
-class MyVertex  : public vcg::Vertex< MyUsedTypes, vcg::vertex::Color4b, vcg::vertex::Coord3f, vcg::vertex::VFAdj, vcg::vertex::Normal3f, vcg::vertex::BitFlags  >{};
+class MyVertex  : public vcg::Vertex< MyUsedTypes, vcg::vertex::Color4b, vcg::vertex::Coord3f, vcg::vertex::VFAdj, vcg::vertex::Normal3f, vcg::vertex::Qualityf, vcg::vertex::BitFlags  >{};
 class MyFace    : public vcg::Face<   MyUsedTypes, vcg::face::Color4b, vcg::face::FFAdj, vcg::face::VFAdj, vcg::face::VertexRef, vcg::face::BitFlags > {};
 class MyEdge    : public vcg::Edge<   MyUsedTypes> {};
   
@@ -8,7 +8,17 @@
    IMAGELIST,
    OUTDIR,
    NVM,
-   CHANGEMASK
+   CHANGEMASK,
+   MASKIMG,
+   CAMERA,
+   VOXRES,
+   FUSEVOTES,
+   MINAREA,
+   RAYSTRIDE,
+   RAYDEPTH,
+   MRFSOLVER,
+   MRFALPHA,
+   FEATGROUPING
  };
 
 extern inputFiles inFiles;
@@ -8,6 +8,7 @@ Change detection main test function.
 
 #include <map>
 #include <string>
+#include <cstdlib>
 
 /**Main function*/
 int main(int argc, char** argv){
@@ -35,6 +36,22 @@ int main(int argc, char** argv){
 
   //inputStrings[CHANGEMASK] = "change_mask.ply";
   // testEnerMin(inputStrings);
+
+  if(inputStrings.count(MASKIMG) && inputStrings.count(NVM) && inputStrings.count(MESH)){
+    int cam_idx = inputStrings.count(CAMERA) ? atoi(inputStrings[CAMERA].c_str()) : 0;
+    double resolution = inputStrings.count(VOXRES) ? atof(inputStrings[VOXRES].c_str()) : 0.01;
+    benchmarkRayShooting(inputStrings, cam_idx, resolution);
+  }
+
+  // with a solver given the change mask is segmented by it, otherwise all solvers are benchmarked
+  if(inputStrings.count(MESH) && inputStrings.count(CHANGEMASK)){
+    double resolution = inputStrings.count(VOXRES) ? atof(inputStrings[VOXRES].c_str()) : 0.01;
+    double alpha = inputStrings.count(MRFALPHA) ? atof(inputStrings[MRFALPHA].c_str()) : 1;
+    if(inputStrings.count(MRFSOLVER))
+      energyMin(inputStrings, resolution, alpha);
+    else
+      benchmarkMaxflow(inputStrings, resolution, alpha);
+  }
   
   return 0;
 
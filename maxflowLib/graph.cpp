@@ -83,13 +83,14 @@ template <typename captype, typename tcaptype, typename flowtype>
 }
 
 template <typename captype, typename tcaptype, typename flowtype> 
-	void Graph<captype,tcaptype,flowtype>::reallocate_arcs()
+	void Graph<captype,tcaptype,flowtype>::reallocate_arcs(int num)
 {
 	int arc_num_max = (int)(arc_max - arcs);
 	int arc_num = (int)(arc_last - arcs);
 	arc* arcs_old = arcs;
 
 	arc_num_max += arc_num_max / 2; if (arc_num_max & 1) arc_num_max ++;
+	if (arc_num_max < arc_num + 2*num) arc_num_max = arc_num + 2*num;
 	arcs = (arc*) realloc(arcs_old, arc_num_max*sizeof(arc));
 	if (!arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
 
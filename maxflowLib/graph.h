@@ -247,6 +247,20 @@ public:
 		nodes[i].is_in_changed_list = 0;
 	}
 
+	////////////////////////////
+	// 6. Bulk loading edges. //
+	////////////////////////////
+
+	// Makes room for 'num' more edges with at most one reallocation, so that
+	// the following add_edge()/add_edges() calls do not reallocate arcs.
+	void reserve_edges(int num);
+
+	// Adds 'num' bidirectional edges i[k]-j[k] with weights cap[k] and rev_cap[k].
+	// Arcs end up in the same order as with 'num' calls of add_edge(), so
+	// edges collected in parallel (e.g. one buffer per thread) can be appended
+	// buffer by buffer and give the same graph as a serial construction.
+	void add_edges(int num, const node_id* i, const node_id* j, const captype* cap, const captype* rev_cap);
+
 
 
 
@@ -319,7 +333,7 @@ private:
 	/////////////////////////////////////////////////////////////////////////
 
 	void reallocate_nodes(int num); // num is the number of new nodes
-	void reallocate_arcs();
+	void reallocate_arcs(int num = 1); // num is the number of new edges
 
 	// functions for processing active list
 	void set_active(node *i);
@@ -425,6 +439,46 @@ template <typename captype, typename tcaptype, typename flowtype>
 	a_rev -> r_cap = rev_cap;
 }
 
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::reserve_edges(int num)
+{
+	assert(num >= 0);
+
+	if (arc_last + 2*num > arc_max) reallocate_arcs(num);
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::add_edges(int num, const node_id* _i, const node_id* _j, const captype* cap, const captype* rev_cap)
+{
+	reserve_edges(num);
+
+	for (int k=0; k<num; k++)
+	{
+		assert(_i[k] >= 0 && _i[k] < node_num);
+		assert(_j[k] >= 0 && _j[k] < node_num);
+		assert(_i[k] != _j[k]);
+		assert(cap[k] >= 0);
+		assert(rev_cap[k] >= 0);
+
+		arc *a = arc_last ++;
+		arc *a_rev = arc_last ++;
+
+		node* i = nodes + _i[k];
+		node* j = nodes + _j[k];
+
+		a -> sister = a_rev;
+		a_rev -> sister = a;
+		a -> next = i -> first;
+		i -> first = a;
+		a_rev -> next = j -> first;
+		j -> first = a_rev;
+		a -> head = j;
+		a_rev -> head = i;
+		a -> r_cap = cap[k];
+		a_rev -> r_cap = rev_cap[k];
+	}
+}
+
 template <typename captype, typename tcaptype, typename flowtype> 
 	inline typename Graph<captype,tcaptype,flowtype>::arc* Graph<captype,tcaptype,flowtype>::get_first_arc()
 {
@@ -0,0 +1,544 @@
+/* gridGraph.cpp */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "gridGraph.h"
+
+
+#define INFINITE_D ((int)(((unsigned)-1)/2))		/* infinite distance to the terminal */
+
+
+template <typename captype, typename tcaptype, typename flowtype>
+	GridGraph<captype,tcaptype,flowtype>::GridGraph(int _width, int _height, int _depth, int connectivity, void (*err_function)(char *))
+	: width(_width), height(_height), depth(_depth),
+	  r_cap(NULL), tr_cap(NULL), parent(NULL), is_sink(NULL), TS(NULL), DIST(NULL), next(NULL),
+	  error_function(err_function),
+	  flow(0)
+{
+	if (connectivity != 6 && connectivity != 18 && connectivity != 26) error((char *)"Connectivity must be 6, 18 or 26!");
+	if (width <= 0 || height <= 0 || depth <= 0) error((char *)"Grid dimensions must be positive!");
+
+	block_num[0] = (width  + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	block_num[1] = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	block_num[2] = (depth  + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	double node_num_d = (double)block_num[0]*block_num[1]*block_num[2]*BLOCK_SIZE*BLOCK_SIZE*BLOCK_SIZE;
+	if (node_num_d > INT_MAX) error((char *)"Grid is too large!");
+	node_num_max = (int)node_num_d;
+
+	/* neighborhood: directions whose sum of absolute offsets is at most 1, 2 or 3 */
+	int max_dist = (connectivity == 6) ? 1 : ((connectivity == 18) ? 2 : 3);
+	int dx, dy, dz, k;
+
+	K = 0;
+	for (dz=-1; dz<=1; dz++)
+	for (dy=-1; dy<=1; dy++)
+	for (dx=-1; dx<=1; dx++)
+	{
+		int dist = abs(dx) + abs(dy) + abs(dz);
+		int idx = (dz+1)*9 + (dy+1)*3 + (dx+1);
+		if (dist == 0 || dist > max_dist) { dir_index[idx] = -1; continue; }
+
+		offset[K][0] = dx;
+		offset[K][1] = dy;
+		offset[K][2] = dz;
+		dir_index[idx] = K ++;
+	}
+	for (k=0; k<K; k++)
+	{
+		sister[k] = dir_index[(1-offset[k][2])*9 + (1-offset[k][1])*3 + (1-offset[k][0])];
+	}
+
+	r_cap   = (captype*) calloc((size_t)node_num_max*K, sizeof(captype));
+	tr_cap  = (tcaptype*) calloc(node_num_max, sizeof(tcaptype));
+	parent  = (unsigned char*) malloc(node_num_max);
+	is_sink = (unsigned char*) calloc(node_num_max, 1);
+	TS      = (int*) malloc(node_num_max*sizeof(int));
+	DIST    = (int*) malloc(node_num_max*sizeof(int));
+	next    = (node_id*) malloc(node_num_max*sizeof(node_id));
+	if (!r_cap || !tr_cap || !parent || !is_sink || !TS || !DIST || !next) error((char *)"Not enough memory!");
+
+	memset(parent, NO_PARENT, node_num_max);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	GridGraph<captype,tcaptype,flowtype>::~GridGraph()
+{
+	free(r_cap);
+	free(tr_cap);
+	free(parent);
+	free(is_sink);
+	free(TS);
+	free(DIST);
+	free(next);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::error(char *msg)
+{
+	if (error_function) (*error_function)(msg);
+	exit(1);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::add_edges(int num, const node_id* i, const node_id* j, const captype* cap, const captype* rev_cap)
+{
+	for (int k=0; k<num; k++)
+	{
+		add_edge(i[k], j[k], cap[k], rev_cap[k]);
+	}
+}
+
+/***********************************************************************/
+
+/*
+	Active list and orphan list work as in maxflow.cpp, with node ids
+	instead of pointers: next[i] == -1 iff i is not in the active list.
+*/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_active(node_id i)
+{
+	if (next[i] < 0)
+	{
+		/* it's not in the list yet */
+		if (queue_last[1] >= 0) next[queue_last[1]] = i;
+		else                    queue_first[1]      = i;
+		queue_last[1] = i;
+		next[i] = i;
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename GridGraph<captype,tcaptype,flowtype>::node_id GridGraph<captype,tcaptype,flowtype>::next_active()
+{
+	node_id i;
+
+	while ( 1 )
+	{
+		if ((i=queue_first[0]) < 0)
+		{
+			queue_first[0] = i = queue_first[1];
+			queue_last[0]  = queue_last[1];
+			queue_first[1] = -1;
+			queue_last[1]  = -1;
+			if (i < 0) return -1;
+		}
+
+		/* remove it from the active list */
+		if (next[i] == i) queue_first[0] = queue_last[0] = -1;
+		else              queue_first[0] = next[i];
+		next[i] = -1;
+
+		/* a node in the list is active iff it has a parent */
+		if (parent[i] != NO_PARENT) return i;
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_orphan_front(node_id i)
+{
+	parent[i] = ORPHAN;
+	orphans.push_front(i);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_orphan_rear(node_id i)
+{
+	parent[i] = ORPHAN;
+	orphans.push_back(i);
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::maxflow_init()
+{
+	queue_first[0] = queue_last[0] = -1;
+	queue_first[1] = queue_last[1] = -1;
+	orphans.clear();
+
+	TIME = 0;
+
+	for (node_id i=0; i<node_num_max; i++)
+	{
+		next[i] = -1;
+		TS[i] = TIME;
+		if (tr_cap[i] > 0)
+		{
+			/* i is connected to the source */
+			is_sink[i] = 0;
+			parent[i] = TERMINAL;
+			set_active(i);
+			DIST[i] = 1;
+		}
+		else if (tr_cap[i] < 0)
+		{
+			/* i is connected to the sink */
+			is_sink[i] = 1;
+			parent[i] = TERMINAL;
+			set_active(i);
+			DIST[i] = 1;
+		}
+		else
+		{
+			parent[i] = NO_PARENT;
+		}
+	}
+}
+
+/*
+	Augments along the path through arc (i, direction k) = i->j,
+	i is in the source tree and j in the sink tree.
+	Parent of node u is get_neighbor(u, parent[u]), the arc to it is rc(u, parent[u])
+	and the arc from it is rc(parent, sister[parent[u]]).
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::augment(node_id middle_i, int middle_k, node_id middle_j)
+{
+	node_id i, p;
+	int d;
+	tcaptype bottleneck;
+
+
+	/* 1. Finding bottleneck capacity */
+	/* 1a - the source tree */
+	bottleneck = rc(middle_i, middle_k);
+	for (i=middle_i; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = get_neighbor(i, d);
+		if (bottleneck > rc(p, sister[d])) bottleneck = rc(p, sister[d]);
+	}
+	if (bottleneck > tr_cap[i]) bottleneck = tr_cap[i];
+	/* 1b - the sink tree */
+	for (i=middle_j; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = get_neighbor(i, d);
+		if (bottleneck > rc(i, d)) bottleneck = rc(i, d);
+	}
+	if (bottleneck > - tr_cap[i]) bottleneck = - tr_cap[i];
+
+
+	/* 2. Augmenting */
+	/* 2a - the source tree */
+	rc(middle_j, sister[middle_k]) += bottleneck;
+	rc(middle_i, middle_k) -= bottleneck;
+	for (i=middle_i; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = get_neighbor(i, d);
+		rc(i, d) += bottleneck;
+		rc(p, sister[d]) -= bottleneck;
+		if (!rc(p, sister[d]))
+		{
+			set_orphan_front(i); // add i to the beginning of the adoption list
+		}
+	}
+	tr_cap[i] -= bottleneck;
+	if (!tr_cap[i])
+	{
+		set_orphan_front(i); // add i to the beginning of the adoption list
+	}
+	/* 2b - the sink tree */
+	for (i=middle_j; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = get_neighbor(i, d);
+		rc(p, sister[d]) += bottleneck;
+		rc(i, d) -= bottleneck;
+		if (!rc(i, d))
+		{
+			set_orphan_front(i); // add i to the beginning of the adoption list
+		}
+	}
+	tr_cap[i] += bottleneck;
+	if (!tr_cap[i])
+	{
+		set_orphan_front(i); // add i to the beginning of the adoption list
+	}
+
+
+	flow += bottleneck;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::process_source_orphan(node_id i)
+{
+	node_id j;
+	int x, y, z, k, k_min = NO_PARENT, a;
+	int d, d_min = INFINITE_D;
+
+	get_coords(i, x, y, z);
+
+	/* trying to find a new parent */
+	for (k=0; k<K; k++)
+	{
+		if ((j = get_neighbor(x, y, z, k)) < 0 || !rc(j, sister[k])) continue;
+		if (is_sink[j] || parent[j] == NO_PARENT) continue;
+
+		/* checking the origin of j */
+		d = 0;
+		while ( 1 )
+		{
+			if (TS[j] == TIME)
+			{
+				d += DIST[j];
+				break;
+			}
+			a = parent[j];
+			d ++;
+			if (a == TERMINAL)
+			{
+				TS[j] = TIME;
+				DIST[j] = 1;
+				break;
+			}
+			if (a == ORPHAN) { d = INFINITE_D; break; }
+			j = get_neighbor(j, a);
+		}
+		if (d < INFINITE_D) /* j originates from the source - done */
+		{
+			if (d < d_min)
+			{
+				k_min = k;
+				d_min = d;
+			}
+			/* set marks along the path */
+			for (j=get_neighbor(x, y, z, k); TS[j]!=TIME; j=get_neighbor(j, parent[j]))
+			{
+				TS[j] = TIME;
+				DIST[j] = d --;
+			}
+		}
+	}
+
+	if ((parent[i] = k_min) != NO_PARENT)
+	{
+		TS[i] = TIME;
+		DIST[i] = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found, process neighbors */
+		for (k=0; k<K; k++)
+		{
+			if ((j = get_neighbor(x, y, z, k)) < 0) continue;
+			if (!is_sink[j] && (a = parent[j]) != NO_PARENT)
+			{
+				if (rc(j, sister[k])) set_active(j);
+				if (a == sister[k])
+				{
+					set_orphan_rear(j); // add j to the end of the adoption list
+				}
+			}
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::process_sink_orphan(node_id i)
+{
+	node_id j;
+	int x, y, z, k, k_min = NO_PARENT, a;
+	int d, d_min = INFINITE_D;
+
+	get_coords(i, x, y, z);
+
+	/* trying to find a new parent */
+	for (k=0; k<K; k++)
+	{
+		if (!rc(i, k) || (j = get_neighbor(x, y, z, k)) < 0) continue;
+		if (!is_sink[j] || parent[j] == NO_PARENT) continue;
+
+		/* checking the origin of j */
+		d = 0;
+		while ( 1 )
+		{
+			if (TS[j] == TIME)
+			{
+				d += DIST[j];
+				break;
+			}
+			a = parent[j];
+			d ++;
+			if (a == TERMINAL)
+			{
+				TS[j] = TIME;
+				DIST[j] = 1;
+				break;
+			}
+			if (a == ORPHAN) { d = INFINITE_D; break; }
+			j = get_neighbor(j, a);
+		}
+		if (d < INFINITE_D) /* j originates from the sink - done */
+		{
+			if (d < d_min)
+			{
+				k_min = k;
+				d_min = d;
+			}
+			/* set marks along the path */
+			for (j=get_neighbor(x, y, z, k); TS[j]!=TIME; j=get_neighbor(j, parent[j]))
+			{
+				TS[j] = TIME;
+				DIST[j] = d --;
+			}
+		}
+	}
+
+	if ((parent[i] = k_min) != NO_PARENT)
+	{
+		TS[i] = TIME;
+		DIST[i] = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found, process neighbors */
+		for (k=0; k<K; k++)
+		{
+			if ((j = get_neighbor(x, y, z, k)) < 0) continue;
+			if (is_sink[j] && (a = parent[j]) != NO_PARENT)
+			{
+				if (rc(i, k)) set_active(j);
+				if (a == sister[k])
+				{
+					set_orphan_rear(j); // add j to the end of the adoption list
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype GridGraph<captype,tcaptype,flowtype>::maxflow()
+{
+	node_id i, j, current_node = -1;
+	node_id middle_i = -1, middle_j = -1;
+	int x, y, z, k, middle_k = -1;
+
+	maxflow_init();
+
+	// main loop
+	while ( 1 )
+	{
+		if ((i=current_node) >= 0)
+		{
+			next[i] = -1; /* remove active flag */
+			if (parent[i] == NO_PARENT) i = -1;
+		}
+		if (i < 0)
+		{
+			if ((i = next_active()) < 0) break;
+		}
+
+		get_coords(i, x, y, z);
+		middle_k = -1;
+
+		/* growth */
+		if (!is_sink[i])
+		{
+			/* grow source tree */
+			for (k=0; k<K; k++)
+			if (rc(i, k))
+			{
+				j = get_neighbor(x, y, z, k);
+				if (parent[j] == NO_PARENT)
+				{
+					is_sink[j] = 0;
+					parent[j] = sister[k];
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+					set_active(j);
+				}
+				else if (is_sink[j]) { middle_i = i; middle_j = j; middle_k = k; break; }
+				else if (TS[j] <= TS[i] &&
+				         DIST[j] > DIST[i])
+				{
+					/* heuristic - trying to make the distance from j to the source shorter */
+					parent[j] = sister[k];
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+				}
+			}
+		}
+		else
+		{
+			/* grow sink tree */
+			for (k=0; k<K; k++)
+			{
+				if ((j = get_neighbor(x, y, z, k)) < 0 || !rc(j, sister[k])) continue;
+				if (parent[j] == NO_PARENT)
+				{
+					is_sink[j] = 1;
+					parent[j] = sister[k];
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+					set_active(j);
+				}
+				else if (!is_sink[j]) { middle_i = j; middle_j = i; middle_k = sister[k]; break; }
+				else if (TS[j] <= TS[i] &&
+				         DIST[j] > DIST[i])
+				{
+					/* heuristic - trying to make the distance from j to the sink shorter */
+					parent[j] = sister[k];
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+				}
+			}
+		}
+
+		TIME ++;
+
+		if (middle_k >= 0)
+		{
+			next[i] = i; /* set active flag */
+			current_node = i;
+
+			/* augmentation */
+			augment(middle_i, middle_k, middle_j);
+			/* augmentation end */
+
+			/* adoption */
+			while (!orphans.empty())
+			{
+				j = orphans.front();
+				orphans.pop_front();
+				if (is_sink[j]) process_sink_orphan(j);
+				else            process_source_orphan(j);
+			}
+			/* adoption end */
+		}
+		else current_node = -1;
+	}
+
+	return flow;
+}
+
+/***********************************************************************/
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4661)
+#endif
+
+// Instantiations: <captype, tcaptype, flowtype>
+// IMPORTANT:
+//    flowtype should be 'larger' than tcaptype
+//    tcaptype should be 'larger' than captype
+
+template class GridGraph<short,int,int>;
+template class GridGraph<int,int,int>;
+template class GridGraph<float,float,float>;
+template class GridGraph<double,double,double>;
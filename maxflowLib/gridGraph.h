@@ -0,0 +1,205 @@
+/* gridGraph.h */
+/*
+	Boykov-Kolmogorov maxflow (see graph.h) specialized for regular 3D lattices.
+
+	Every node is a cell (x,y,z) of a width x height x depth grid and can only be
+	connected to its 6, 18 or 26 neighbors. Arcs are not stored explicitly:
+	the head of an arc is given by a fixed offset per direction, its sister by
+	the opposite direction, and a node keeps one residual capacity per direction.
+	With captype = short an arc costs 2 bytes instead of the 32 bytes of a
+	Graph arc (head, next and sister pointers plus capacity).
+
+	Nodes are laid out in blocks of BLOCK_SIZE^3 cells, so neighbors in all three
+	directions are usually in the same few cache lines.
+
+	The interface follows Graph: add_edge(), add_edges(), add_tweights(),
+	maxflow() and what_segment(). Node ids are obtained with get_node_id(x,y,z)
+	and all nodes exist from construction, so there is no add_node().
+	Reusing trees is not supported.
+*/
+
+#ifndef __GRIDGRAPH_H__
+#define __GRIDGRAPH_H__
+
+#include <stddef.h>
+#include <deque>
+
+// Current instantiations are at the end of gridGraph.cpp
+template <typename captype, typename tcaptype, typename flowtype> class GridGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; // terminals
+	typedef int node_id;
+
+	// Constructor. Creates all width*height*depth nodes with zero capacities.
+	// connectivity is 6 (faces), 18 (faces and edges) or 26 (whole 3x3x3 block).
+	// If an error occurs err_function is called with the message, then exit(1).
+	GridGraph(int width, int height, int depth, int connectivity = 26, void (*err_function)(char *) = NULL);
+
+	// Destructor
+	~GridGraph();
+
+	// Returns id of the node of cell (x,y,z)
+	node_id get_node_id(int x, int y, int z) const
+	{
+		return ((((z >> BLOCK_BITS)*block_num[1] + (y >> BLOCK_BITS))*block_num[0] + (x >> BLOCK_BITS)) << (3*BLOCK_BITS))
+			| ((z & BLOCK_MASK) << (2*BLOCK_BITS)) | ((y & BLOCK_MASK) << BLOCK_BITS) | (x & BLOCK_MASK);
+	}
+
+	int get_node_num() const { return width*height*depth; }
+	int get_connectivity() const { return K; }
+
+	// Adds capacities cap (i->j) and rev_cap (j->i) to the arcs between lattice
+	// neighbors 'i' and 'j'. Calling it again for the same pair adds up the capacities.
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap);
+
+	// Adds 'num' edges i[k]-j[k], see add_edge()
+	void add_edges(int num, const node_id* i, const node_id* j, const captype* cap, const captype* rev_cap);
+
+	// Arcs of the lattice are preallocated, present for compatibility with Graph
+	void reserve_edges(int /*num*/) {}
+
+	// Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights, as in Graph
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	// Computes the maxflow. Can be called several times.
+	flowtype maxflow();
+
+	// After the maxflow is computed, this function returns to which
+	// segment the node 'i' belongs, default_segm if it can be assigned to both.
+	termtype what_segment(node_id i, termtype default_segm = SOURCE) const
+	{
+		if (parent[i] != NO_PARENT) return (is_sink[i]) ? SINK : SOURCE;
+		else                        return default_segm;
+	}
+
+private:
+	// internal variables and functions
+
+	static const int BLOCK_BITS = 2;
+	static const int BLOCK_SIZE = 1 << BLOCK_BITS;
+	static const int BLOCK_MASK = BLOCK_SIZE - 1;
+
+	// special values of parent[], other values are directions to the parent
+	static const unsigned char NO_PARENT = 255;
+	static const unsigned char TERMINAL  = 254;
+	static const unsigned char ORPHAN    = 253;
+
+	int					width, height, depth;
+	int					block_num[3];	// number of blocks along every axis
+	int					node_num_max;	// number of nodes including padding of the last blocks
+
+	int					K;				// number of directions
+	int					offset[26][3];	// offset of the neighbor in every direction
+	int					sister[26];		// opposite direction
+	int					dir_index[27];	// direction of offset (dx,dy,dz), -1 if not a neighbor
+
+	captype				*r_cap;		// residual capacity of arc (i, direction k) at r_cap[i*K+k]
+	tcaptype			*tr_cap;	// as node::tr_cap in Graph
+	unsigned char		*parent;	// direction to the parent, NO_PARENT, TERMINAL or ORPHAN
+	unsigned char		*is_sink;
+	int					*TS;		// timestamp showing when DIST was computed
+	int					*DIST;		// distance to the terminal
+	node_id				*next;		// next active node, -1 if not active, itself if the last one
+
+	void	(*error_function)(char *);
+
+	flowtype			flow;		// total flow
+
+	node_id				queue_first[2], queue_last[2];	// list of active nodes
+	std::deque<node_id>	orphans;
+	int					TIME;
+
+	void error(char *msg);
+
+	captype& rc(node_id i, int k) { return r_cap[(size_t)i*K + k]; }
+
+	void get_coords(node_id i, int& x, int& y, int& z) const;
+	node_id get_neighbor(int x, int y, int z, int k) const;
+	node_id get_neighbor(node_id i, int k) const;
+
+	void set_active(node_id i);
+	node_id next_active();
+
+	void set_orphan_front(node_id i);
+	void set_orphan_rear(node_id i);
+
+	void maxflow_init();
+	void augment(node_id i, int k, node_id j);
+	void process_source_orphan(node_id i);
+	void process_sink_orphan(node_id i);
+};
+
+///////////////////////////////////////
+// Implementation - inline functions //
+///////////////////////////////////////
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::get_coords(node_id i, int& x, int& y, int& z) const
+{
+	int b = i >> (3*BLOCK_BITS);
+	int l = i & ((1 << (3*BLOCK_BITS)) - 1);
+
+	x = (b % block_num[0])*BLOCK_SIZE + (l & BLOCK_MASK);
+	b /= block_num[0];
+	y = (b % block_num[1])*BLOCK_SIZE + ((l >> BLOCK_BITS) & BLOCK_MASK);
+	z = (b / block_num[1])*BLOCK_SIZE + (l >> (2*BLOCK_BITS));
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename GridGraph<captype,tcaptype,flowtype>::node_id GridGraph<captype,tcaptype,flowtype>::get_neighbor(int x, int y, int z, int k) const
+{
+	x += offset[k][0];
+	y += offset[k][1];
+	z += offset[k][2];
+	if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) return -1;
+	return get_node_id(x, y, z);
+}
+
+// Neighbor of i in direction k, which must be inside the grid (e.g. the parent of a node).
+// Uses only bit operations: local coordinates wrap around the block and carry into the block index.
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename GridGraph<captype,tcaptype,flowtype>::node_id GridGraph<captype,tcaptype,flowtype>::get_neighbor(node_id i, int k) const
+{
+	int lx = (i & BLOCK_MASK) + offset[k][0];
+	int ly = ((i >> BLOCK_BITS) & BLOCK_MASK) + offset[k][1];
+	int lz = ((i >> (2*BLOCK_BITS)) & BLOCK_MASK) + offset[k][2];
+
+	int b = (i >> (3*BLOCK_BITS))
+		+ (lx >> BLOCK_BITS)
+		+ (ly >> BLOCK_BITS)*block_num[0]
+		+ (lz >> BLOCK_BITS)*block_num[0]*block_num[1];
+
+	return (b << (3*BLOCK_BITS)) | ((lz & BLOCK_MASK) << (2*BLOCK_BITS)) | ((ly & BLOCK_MASK) << BLOCK_BITS) | (lx & BLOCK_MASK);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	tcaptype delta = tr_cap[i];
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	tr_cap[i] = cap_source - cap_sink;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::add_edge(node_id i, node_id j, captype cap, captype rev_cap)
+{
+	int xi, yi, zi, xj, yj, zj;
+	get_coords(i, xi, yi, zi);
+	get_coords(j, xj, yj, zj);
+
+	int dx = xj - xi, dy = yj - yi, dz = zj - zi;
+	int k = (dx < -1 || dx > 1 || dy < -1 || dy > 1 || dz < -1 || dz > 1) ? -1 : dir_index[(dz+1)*9 + (dy+1)*3 + (dx+1)];
+	if (k < 0) { error((char *)"Edge does not connect lattice neighbors!"); return; }
+
+	rc(i, k) += cap;
+	rc(j, sister[k]) += rev_cap;
+}
+
+#endif
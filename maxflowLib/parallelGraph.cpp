@@ -0,0 +1,364 @@
+/* parallelGraph.cpp */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "parallelGraph.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* height of nodes which cannot reach the sink, real distances are at most node_num */
+#define INFINITE_H (node_num + 1)
+
+
+template <typename captype, typename tcaptype, typename flowtype>
+	ParallelGraph<captype,tcaptype,flowtype>::ParallelGraph(int node_num_max, int edge_num_max, void (*err_function)(char *))
+	: node_num(0),
+	  error_function(err_function),
+	  flow(0)
+{
+	if (node_num_max < 16) node_num_max = 16;
+	if (edge_num_max < 16) edge_num_max = 16;
+
+	tr_cap.reserve(node_num_max);
+	reserve_edges(edge_num_max);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename ParallelGraph<captype,tcaptype,flowtype>::node_id ParallelGraph<captype,tcaptype,flowtype>::add_node(int num)
+{
+	node_id i = node_num;
+	node_num += num;
+	tr_cap.resize(node_num, 0);
+	return i;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ParallelGraph<captype,tcaptype,flowtype>::reserve_edges(int num)
+{
+	edge_i.reserve(edge_i.size() + num);
+	edge_j.reserve(edge_j.size() + num);
+	edge_cap.reserve(edge_cap.size() + num);
+	edge_rev_cap.reserve(edge_rev_cap.size() + num);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ParallelGraph<captype,tcaptype,flowtype>::add_edge(node_id i, node_id j, captype cap, captype rev_cap)
+{
+	if (!arc_first.empty()) { if (error_function) (*error_function)((char *)"Edges cannot be added after maxflow()!"); exit(1); }
+
+	edge_i.push_back(i);
+	edge_j.push_back(j);
+	edge_cap.push_back(cap);
+	edge_rev_cap.push_back(rev_cap);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ParallelGraph<captype,tcaptype,flowtype>::add_edges(int num, const node_id* i, const node_id* j, const captype* cap, const captype* rev_cap)
+{
+	if (!arc_first.empty()) { if (error_function) (*error_function)((char *)"Edges cannot be added after maxflow()!"); exit(1); }
+
+	edge_i.insert(edge_i.end(), i, i + num);
+	edge_j.insert(edge_j.end(), j, j + num);
+	edge_cap.insert(edge_cap.end(), cap, cap + num);
+	edge_rev_cap.insert(edge_rev_cap.end(), rev_cap, rev_cap + num);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ParallelGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	tcaptype delta = tr_cap[i];
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	tr_cap[i] = cap_source - cap_sink;
+}
+
+/***********************************************************************/
+
+/*
+	Converts the edge list to adjacency arrays, the edge list is released
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void ParallelGraph<captype,tcaptype,flowtype>::build_arcs()
+{
+	int e, edge_num = (int)edge_i.size();
+
+	arc_first.assign(node_num + 1, 0);
+	for (e=0; e<edge_num; e++)
+	{
+		arc_first[edge_i[e] + 1] ++;
+		arc_first[edge_j[e] + 1] ++;
+	}
+	for (int i=0; i<node_num; i++) arc_first[i+1] += arc_first[i];
+
+	std::vector<int> pos(arc_first.begin(), arc_first.end() - 1);
+	arc_head.resize(2*edge_num);
+	arc_sister.resize(2*edge_num);
+	r_cap.resize(2*edge_num);
+
+	for (e=0; e<edge_num; e++)
+	{
+		int a = pos[edge_i[e]] ++;
+		int a_rev = pos[edge_j[e]] ++;
+
+		arc_head[a] = edge_j[e];
+		arc_head[a_rev] = edge_i[e];
+		arc_sister[a] = a_rev;
+		arc_sister[a_rev] = a;
+		r_cap[a] = edge_cap[e];
+		r_cap[a_rev] = edge_rev_cap[e];
+	}
+
+	std::vector<node_id>().swap(edge_i);
+	std::vector<node_id>().swap(edge_j);
+	std::vector<captype>().swap(edge_cap);
+	std::vector<captype>().swap(edge_rev_cap);
+}
+
+/*
+	Sets heights to the exact distances to the sink in the residual graph
+	(INFINITE_H if the sink cannot be reached), breadth first search level by level
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void ParallelGraph<captype,tcaptype,flowtype>::global_relabel()
+{
+	const int n = node_num, h_inf = INFINITE_H;
+	int thread_num = 1;
+#ifdef _OPENMP
+	thread_num = omp_get_max_threads();
+#endif
+	std::vector<node_id> frontier;
+	std::vector<std::vector<node_id> > next_frontier(thread_num);
+
+#pragma omp parallel for schedule(static)
+	for (int i=0; i<n; i++) height[i] = h_inf;
+
+	for (int i=0; i<n; i++)
+	if (t_cap[i] > 0)
+	{
+		height[i] = 1;
+		frontier.push_back(i);
+	}
+
+	for (int level=1; !frontier.empty(); level++)
+	{
+#pragma omp parallel num_threads(thread_num)
+		{
+			int thread_id = 0;
+#ifdef _OPENMP
+			thread_id = omp_get_thread_num();
+#endif
+			std::vector<node_id> &local = next_frontier[thread_id];
+
+#pragma omp for schedule(dynamic, 256)
+			for (int k=0; k<(int)frontier.size(); k++)
+			{
+				node_id i = frontier[k];
+				for (int a=arc_first[i]; a<arc_first[i+1]; a++)
+				{
+					node_id j = arc_head[a];
+					/* j can reach i if the arc j->i has residual capacity */
+					if (r_cap[arc_sister[a]] > 0 && height[j] == h_inf &&
+					    __sync_bool_compare_and_swap(&height[j], h_inf, level + 1))
+					{
+						local.push_back(j);
+					}
+				}
+			}
+		}
+
+		frontier.clear();
+		for (int t=0; t<thread_num; t++)
+		{
+			frontier.insert(frontier.end(), next_frontier[t].begin(), next_frontier[t].end());
+			next_frontier[t].clear();
+		}
+	}
+}
+
+/*
+	Adds the node to the next list of active nodes unless it is already there
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void ParallelGraph<captype,tcaptype,flowtype>::enqueue(node_id i, std::vector<node_id> &next_active)
+{
+	if (__sync_bool_compare_and_swap(&queued[i], 0, 1)) next_active.push_back(i);
+}
+
+/*
+	Pushes excess of node i to its lowest residual neighbor or relabels it, at most DISCHARGE_STEPS times.
+	Only the thread discharging i decreases its excess and the residual capacities of its arcs,
+	other threads may only increase them. Returns the number of relabels.
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	long long ParallelGraph<captype,tcaptype,flowtype>::discharge(node_id i, std::vector<node_id> &next_active, flowtype &sink_flow)
+{
+	const int h_inf = INFINITE_H;
+	long long relabels = 0;
+	volatile tcaptype *ex = &excess[0];
+	volatile captype *rc = &r_cap[0];
+	volatile int *h = &height[0];
+
+	for (int step=0; step<DISCHARGE_STEPS; step++)
+	{
+		tcaptype e = ex[i];
+		if (e <= 0 || h[i] >= h_inf) break;
+
+		/* lowest neighbor reachable by a residual arc, the sink has height 0 */
+		int h_min = INT_MAX, a_min = -1;
+		if (t_cap[i] > 0) h_min = 0;
+
+		for (int a=arc_first[i]; a<arc_first[i+1] && h_min>0; a++)
+		if (rc[a] > 0)
+		{
+			int h_j = h[arc_head[a]];
+			if (h_j < h_min) { h_min = h_j; a_min = a; }
+		}
+
+		if (h_min == INT_MAX)
+		{
+			h[i] = h_inf;
+			relabels ++;
+			break;
+		}
+
+		if (h[i] > h_min)
+		{
+			if (a_min < 0)
+			{
+				/* push to the sink */
+				tcaptype d = (e < t_cap[i]) ? e : t_cap[i];
+				t_cap[i] -= d;
+				__sync_fetch_and_sub(&excess[i], d);
+				sink_flow += d;
+			}
+			else
+			{
+				/* push to a neighbor */
+				node_id j = arc_head[a_min];
+				captype c = rc[a_min];
+				captype d = (e < c) ? (captype)e : c;
+				__sync_fetch_and_sub(&r_cap[a_min], d);
+				__sync_fetch_and_add(&r_cap[arc_sister[a_min]], d);
+				__sync_fetch_and_sub(&excess[i], d);
+				__sync_fetch_and_add(&excess[j], d);
+				if (h[j] < h_inf) enqueue(j, next_active);
+			}
+		}
+		else
+		{
+			/* relabel */
+			h[i] = (h_min + 1 < h_inf) ? h_min + 1 : h_inf;
+			relabels ++;
+		}
+	}
+
+	if (ex[i] > 0 && h[i] < h_inf) enqueue(i, next_active);
+
+	return relabels;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype ParallelGraph<captype,tcaptype,flowtype>::maxflow()
+{
+	const int n = node_num;
+
+	if (!arc_first.empty()) return flow; /* already computed */
+
+	build_arcs();
+
+	int thread_num = 1;
+#ifdef _OPENMP
+	thread_num = omp_get_max_threads();
+#endif
+
+	excess.assign(n, 0);
+	t_cap.assign(n, 0);
+	height.assign(n, INFINITE_H);
+	queued.assign(n, 0);
+
+	/* preflow: terminal arcs from the source are saturated */
+	std::vector<node_id> active;
+	for (int i=0; i<n; i++)
+	{
+		if (tr_cap[i] > 0)
+		{
+			excess[i] = tr_cap[i];
+			queued[i] = 1;
+			active.push_back(i);
+		}
+		else t_cap[i] = -tr_cap[i];
+	}
+
+	global_relabel();
+
+	const long long relabel_limit = (long long)n*GLOBAL_RELABEL_NUM/GLOBAL_RELABEL_DEN + 1;
+	long long relabels = 0;
+	std::vector<std::vector<node_id> > next_active(thread_num);
+
+	// main loop
+	while (!active.empty())
+	{
+		if (relabels >= relabel_limit)
+		{
+			global_relabel();
+			relabels = 0;
+		}
+
+		flowtype sink_flow = 0;
+		long long phase_relabels = 0;
+
+#pragma omp parallel num_threads(thread_num) reduction(+:sink_flow, phase_relabels)
+		{
+			int thread_id = 0;
+#ifdef _OPENMP
+			thread_id = omp_get_thread_num();
+#endif
+			std::vector<node_id> &local = next_active[thread_id];
+
+#pragma omp for schedule(dynamic, 64)
+			for (int k=0; k<(int)active.size(); k++)
+			{
+				node_id i = active[k];
+				queued[i] = 0;
+				phase_relabels += discharge(i, local, sink_flow);
+			}
+		}
+
+		flow += sink_flow;
+		relabels += phase_relabels;
+
+		active.clear();
+		for (int t=0; t<thread_num; t++)
+		{
+			active.insert(active.end(), next_active[t].begin(), next_active[t].end());
+			next_active[t].clear();
+		}
+	}
+
+	/* excess left in the graph cannot reach the sink, the sink side of the cut are the nodes that can */
+	global_relabel();
+
+	sink_side.resize(n);
+	for (int i=0; i<n; i++) sink_side[i] = (height[i] < INFINITE_H);
+
+	return flow;
+}
+
+/***********************************************************************/
+
+// Instantiations: <captype, tcaptype, flowtype>
+// IMPORTANT:
+//    flowtype should be 'larger' than tcaptype
+//    tcaptype should be 'larger' than captype
+//    only integral types, capacities are updated with atomic operations
+
+template class ParallelGraph<short,int,int>;
+template class ParallelGraph<int,int,int>;
+template class ParallelGraph<int,int,long long>;
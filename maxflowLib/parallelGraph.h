@@ -0,0 +1,112 @@
+/* parallelGraph.h */
+/*
+	Multi-threaded maxflow with the interface of Graph (see graph.h).
+
+	The solver is the lock-free push-relabel algorithm of
+
+		"A Lock-Free Multi-Threaded Algorithm for the Maximum Flow Problem."
+		Bo Hong. IEEE International Symposium on Parallel and Distributed
+		Processing (IPDPS), 2008
+
+	with the global relabeling heuristic. Active nodes are discharged in
+	parallel (OpenMP); residual capacities and excesses are updated with
+	atomic operations, so a node is only ever discharged by one thread but
+	pushes into it can come from any thread. Distance labels are periodically
+	recomputed by a parallel breadth first search from the sink.
+
+	what_segment() reports SINK for the nodes which can reach the sink in the
+	residual graph of the maximum flow. This set does not depend on which
+	maximum flow was found, so the labels equal those of Graph::what_segment()
+	with default_segm = SOURCE.
+
+	Edges are collected by add_edge()/add_edges() and converted to a compact
+	adjacency array when maxflow() is called. Capacity types must be integral
+	(atomic operations). Reusing trees is not supported.
+*/
+
+#ifndef __PARALLELGRAPH_H__
+#define __PARALLELGRAPH_H__
+
+#include <vector>
+
+// Current instantiations are at the end of parallelGraph.cpp
+template <typename captype, typename tcaptype, typename flowtype> class ParallelGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; // terminals
+	typedef int node_id;
+
+	// Constructor. Arguments are estimates of the number of nodes and edges, as in Graph.
+	ParallelGraph(int node_num_max, int edge_num_max, void (*err_function)(char *) = NULL);
+
+	// Adds node(s) to the graph, returns node_id of the first one
+	node_id add_node(int num = 1);
+
+	// Adds a bidirectional edge between 'i' and 'j' with the weights 'cap' and 'rev_cap'
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap);
+
+	// Adds 'num' edges i[k]-j[k] with weights cap[k] and rev_cap[k]
+	void add_edges(int num, const node_id* i, const node_id* j, const captype* cap, const captype* rev_cap);
+
+	// Makes room for 'num' more edges
+	void reserve_edges(int num);
+
+	// Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights, as in Graph
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	// Computes the maxflow with the OpenMP threads of the calling context
+	flowtype maxflow();
+
+	// After the maxflow is computed, this function returns to which segment the node 'i' belongs.
+	// Nodes which are in neither search tree of Graph cannot be told apart here, they are reported
+	// as SOURCE whatever default_segm is.
+	termtype what_segment(node_id i, termtype /*default_segm*/ = SOURCE) const
+	{
+		return (sink_side[i]) ? SINK : SOURCE;
+	}
+
+	int get_node_num() { return node_num; }
+	int get_arc_num() { return 2*(int)edge_i.size(); }
+
+private:
+	// internal variables and functions
+
+	// pushes and relabels of a node before it goes back to the list of active nodes
+	static const int DISCHARGE_STEPS = 64;
+	// relabels (as a fraction of nodes) after which distance labels are recomputed
+	static const int GLOBAL_RELABEL_NUM = 1;
+	static const int GLOBAL_RELABEL_DEN = 2;
+
+	int						node_num;
+	void					(*error_function)(char *);
+	flowtype				flow;		// total flow
+
+	std::vector<tcaptype>	tr_cap;		// as node::tr_cap in Graph
+
+	// edges as added by the user
+	std::vector<node_id>	edge_i, edge_j;
+	std::vector<captype>	edge_cap, edge_rev_cap;
+
+	// adjacency arrays: arcs of node i are [arc_first[i], arc_first[i+1])
+	std::vector<int>		arc_first;
+	std::vector<node_id>	arc_head;
+	std::vector<int>		arc_sister;
+	std::vector<captype>	r_cap;
+
+	std::vector<tcaptype>	excess;
+	std::vector<tcaptype>	t_cap;		// residual capacity of the arc to the sink
+	std::vector<int>		height;
+	std::vector<int>		queued;		// 1 if the node is in the next list of active nodes
+	std::vector<unsigned char> sink_side;
+
+	void build_arcs();
+	void global_relabel();
+	long long discharge(node_id i, std::vector<node_id> &next_active, flowtype &sink_flow);
+	void enqueue(node_id i, std::vector<node_id> &next_active);
+};
+
+#endif
@@ -4,28 +4,93 @@
 #include "util/pbaDataInterface.h"
 #include "common/globVariables.hpp"
 #include "util/utilIO.hpp"
+#include "util/spanMask.hpp"
+#include "util/occupancyGrid.hpp"
+#include "util/rayCaster.hpp"
+#include "util/distanceField.hpp"
+#include "util/meshBVH.hpp"
+#include "util/depthBuffer.hpp"
+#include "util/atomicBitset.hpp"
+#include "util/voxelAccumulator.hpp"
+#include "util/camVisibility.hpp"
+#include "util/incrementalGrouping.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <time.h>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+   Function reads integer input argument into value, value is left unchanged if the argument is not given. Returns false if the argument is not an integer.
+*/
+static bool getIntArg(map<int,string> &input_strings, int key, int &value){
+
+  if(!input_strings.count(key))
+    return true;
+
+  const char *str = input_strings[key].c_str();
+  char *end;
+  long tmp = strtol(str, &end, 10);
+
+  if(end == str || *end != '\0')
+    return false;
+
+  value = static_cast<int>(tmp);
+  return true;
+}
 
 void energyMin(map<int, string> input_strings, double resolution, const double &alpha){
+
+  int solver = MRF_SERIAL;
+  if(!getIntArg(input_strings, MRFSOLVER, solver) || (solver != MRF_SERIAL && solver != MRF_PARALLEL)){
+    cout<<"MRF solver has to be 0 (serial) or 1 (parallel)"<<endl;
+    return;
+  }
   
   MeshChangeDetector mcd;
   pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
   pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud2(new pcl::PointCloud<pcl::PointXYZRGBA>);
   
+  std::vector<int> votes;
+
   getPlyFilePCL(input_strings[MESH], cloud);
-  getPlyFilePCL(input_strings[CHANGEMASK], cloud2);
+  MeshIO::getChngMaskVotes(input_strings[CHANGEMASK], cloud2, votes);
 
-  mcd.energyMinimization(cloud, cloud2, resolution, alpha);
+  mcd.energyMinimization(cloud, cloud2, votes, resolution, alpha, solver);
+}
+
+/**
+   Function saves the changed points in their colors
+*/
+static void saveFeatureMask(const vector<int> &chng_idx, const vector<PtCamCorr> &pts_corr, const string &filename){
+
+  vector<vector<vcg::Point3f> > tmp_3d_masks(1);
+  vector<vcg::Color4b> pts_colors;
+
+  for(int i = 0 ; i < chng_idx.size() ; i++){
+    cv::Point3i c = pts_corr[chng_idx[i]].ptc;
+    tmp_3d_masks[0].push_back(pts_corr[chng_idx[i]].pts_3d);
+    pts_colors.push_back(vcg::Color4b(c.x, c.y, c.z, 0));
+  }
+
+  MeshIO::saveChngMask3d(tmp_3d_masks, pts_colors, filename);
 }
 
 void pipelineCorrespondences(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > new_cloud, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > view_points){
 
-  vector<vector<vcg::Point3f> > tmp_3d_masks;
+  int grouping_mode = INCREMENTAL_GROUPING;
+  if(!getIntArg(inputStrings, FEATGROUPING, grouping_mode) || (grouping_mode != BATCH_GROUPING && grouping_mode != INCREMENTAL_GROUPING)){
+    cout<<"Feature grouping has to be 0 (batch) or 1 (incremental)"<<endl;
+    return;
+  }
+
   vector<string> image_filenames, new_image_filenames;
   vector<CameraT> camera_data, newCameraData;
   pcl::KdTreeFLANN<pcl::PointXYZ> kdtree;
@@ -84,9 +149,6 @@ void pipelineCorrespondences(map<int,string> inputStrings, int K, boost::shared_
   FileIO::getNVM(tmpString, newCameraData, new_image_filenames, tmp_corr, cam_feat_map2);
   new_shots = FileIO::nvmCam2vcgShot(newCameraData, new_image_filenames);
  
-  vector<ImgFeature> new_imgs_feat, old_imgs_feat;
-  set<int> new_imgs_idx, old_imgs_idx;
- 
   //Clouds for visualization in GUI
   new_cloud->points.resize(newCameraData.size());
   view_points->points.resize(newCameraData.size());
@@ -95,8 +157,16 @@ void pipelineCorrespondences(map<int,string> inputStrings, int K, boost::shared_
   ofstream myfile;
   myfile.open ("neighbor_cameras.txt");
 
-  set<int> detected_feat_indeces;
-  set<int> gt_change_indeces;
+  //Batch grouping collects features of all cameras and classifies them at once
+  vector<ImgFeature> new_imgs_feat, old_imgs_feat;
+  set<int> new_imgs_idx, old_imgs_idx;
+  //Incremental grouping updates the change points after every registered new camera
+  boost::shared_ptr<IncrementalGrouping> grouping;
+  if(grouping_mode == INCREMENTAL_GROUPING)
+    grouping.reset(new IncrementalGrouping(tmp_pt_cam_corr));
+
+  long long n_new_feats = 0, n_old_feats = 0;
+  int64 t_diff = cv::getTickCount();
 
   for(int i = 0 ; i < newCameraData.size(); i++){
 
@@ -106,48 +176,99 @@ void pipelineCorrespondences(map<int,string> inputStrings, int K, boost::shared_
 
     // Get features from new image
     int tmp_idx = i + start_idx;
-    new_imgs_feat.insert(new_imgs_feat.end(),tmp_cam_feat_map[tmp_idx].begin(),tmp_cam_feat_map[tmp_idx].end());
-    new_imgs_idx.insert(tmp_idx);
+    n_new_feats += tmp_cam_feat_map[tmp_idx].size();
+    if(grouping)
+      grouping->addNewCamera(tmp_idx, tmp_cam_feat_map[tmp_idx]);
+    else{
+      new_imgs_feat.insert(new_imgs_feat.end(), tmp_cam_feat_map[tmp_idx].begin(), tmp_cam_feat_map[tmp_idx].end());
+      new_imgs_idx.insert(tmp_idx);
+    }
     
     //Get features of K neighbors from old image set
     for(int j = 0 ; j < K ; j++){
       myfile << tmp_vec_vec[i][j] <<"\n";
       int old_img_idx = img_idx_map[tmp_vec_vec[i][j]];
-      old_imgs_feat.insert(old_imgs_feat.end(), tmp_cam_feat_map[old_img_idx].begin(), tmp_cam_feat_map[old_img_idx].end());
-	
-      old_imgs_idx.insert(old_img_idx);
+      n_old_feats += tmp_cam_feat_map[old_img_idx].size();
+      if(grouping)
+	grouping->addOldCamera(old_img_idx, tmp_cam_feat_map[old_img_idx]);
+      else{
+	old_imgs_feat.insert(old_imgs_feat.end(), tmp_cam_feat_map[old_img_idx].begin(), tmp_cam_feat_map[old_img_idx].end());
+	old_imgs_idx.insert(old_img_idx);
+      }
     }    
+
+    if(grouping)
+      cout<<"Change points after new image "<<i<<": "<<grouping->size()<<endl;
   }
   myfile.close();
+
+  vector<int> batch_idx;
+  if(!grouping){
+    CamVisibility visibility(tmp_pt_cam_corr);
+    batch_idx = ImgChangeDetector::imgFeatDiff(new_imgs_feat, old_imgs_feat, visibility, new_imgs_idx, old_imgs_idx);
+    //A point is reported once for every camera observing it
+    std::sort(batch_idx.begin(), batch_idx.end());
+    batch_idx.erase(std::unique(batch_idx.begin(), batch_idx.end()), batch_idx.end());
+  }
+  const vector<int> &chng_idx = grouping ? grouping->getChanged() : batch_idx;
   
-  //Run detection using feature grouping
-  vector<vcg::Point3f> out_pts_vect;
-  vector<vcg::Color4b> pts_colors;
-  cout<<"Total features to investigate: "<<new_imgs_feat.size()+old_imgs_feat.size()<<endl;
-  cout<<"Old features: " <<old_imgs_feat.size()<<" New features: "<<new_imgs_feat.size()<<endl;
-  cout<<"size: "<<new_imgs_idx.size()<<endl;
+  cout<<"Total features investigated: "<<n_new_feats+n_old_feats<<endl;
+  cout<<"Old features: " <<n_old_feats<<" New features: "<<n_new_feats<<endl;
+  cout<<"Feature difference time: "<<double(cv::getTickCount() - t_diff)/cv::getTickFrequency()<<" s"<<endl;
+  cout<<"Number of unique points: "<< chng_idx.size()<<endl;
+  cout<<"TN: "<<tmp_pt_cam_corr.size()-chng_idx.size()<<endl;
+  MeshIO::saveOldModelAsPCL(tmp_pt_cam_corr, "old_model.ply");
+  saveFeatureMask(chng_idx, tmp_pt_cam_corr, "change_mask.ply");
+}
 
-  vector<int> corr_indeces = ImgChangeDetector::imgFeatDiff(new_imgs_feat, old_imgs_feat, tmp_pt_cam_corr, new_imgs_idx, old_imgs_idx);
- 
-  for(int i = 0 ; i < corr_indeces.size() ; i++){
-    cv::Point3i c = tmp_pt_cam_corr[corr_indeces[i]].ptc;
-    out_pts_vect.push_back(tmp_pt_cam_corr[corr_indeces[i]].pts_3d);
-    pts_colors.push_back(vcg::Color4b(c.x, c.y, c.z, 0));
+/**
+   Function returns feature pixels of the camera, building them on the first request for the given mask size
+*/
+static const FeaturePixelIndex& getFeatureIndex(map<int, FeaturePixelIndex> &feat_indices, map<int, vector<ImgFeature> > &cam_feat_map, int cam_idx, const cv::Size &size){
 
-    detected_feat_indeces.insert(corr_indeces[i]);
-  }
+  map<int, FeaturePixelIndex>::iterator it = feat_indices.find(cam_idx);
 
-  tmp_3d_masks.push_back(out_pts_vect);
-  cout<<"Number of unique points: "<< detected_feat_indeces.size()<<endl;
-  cout<<"TN: "<<tmp_pt_cam_corr.size()-detected_feat_indeces.size()<<endl;
-  cout<<"Number of masks:"<<tmp_3d_masks.size()<<endl;
-  MeshIO::saveOldModelAsPCL(tmp_pt_cam_corr, "old_model.ply");
-  MeshIO::saveChngMask3d(tmp_3d_masks, pts_colors, "change_mask.ply");
+  if(it != feat_indices.end() && it->second.rows == size.height && it->second.cols == size.width)
+    return it->second;
+
+  FeaturePixelIndex &feat_index = feat_indices[cam_idx];
+  feat_index = FeaturePixelIndex(cam_feat_map[cam_idx], size);
+  return feat_index;
 }
 
 void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > new_cloud, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > view_points, int proj_method, double resolutionVox){
 
-  vector<vector<vcg::Point3f> > tmp_3d_masks;
+  int64 t_pipeline = cv::getTickCount();
+
+  //Number of neighbour masks that have to agree on a change pixel, 0 projects the mask of every pair
+  int fuse_votes = 0;
+  //Change components smaller than this are removed from the masks, 0 keeps the raw masks
+  int min_area = 0;
+
+  if(!getIntArg(inputStrings, FUSEVOTES, fuse_votes) || fuse_votes < 0 || fuse_votes > K){
+    cout<<"Number of fusion votes has to be an integer between 0 and the number of neighbours ("<<K<<")"<<endl;
+    return;
+  }
+  if(!getIntArg(inputStrings, MINAREA, min_area) || min_area < 0){
+    cout<<"Minimal change component area has to be a non-negative integer"<<endl;
+    return;
+  }
+
+  //Coarse grid stride and number of refinements of adaptive ray shooting
+  int ray_stride = RayCaster::SAMPLE_STRIDE;
+  int ray_depth = RayCaster::REFINE_DEPTH;
+
+  if(!getIntArg(inputStrings, RAYSTRIDE, ray_stride) || ray_stride < 1){
+    cout<<"Ray shooting stride has to be a positive integer"<<endl;
+    return;
+  }
+  if(!getIntArg(inputStrings, RAYDEPTH, ray_depth) || ray_depth < 0){
+    cout<<"Ray shooting refinement depth has to be a non-negative integer"<<endl;
+    return;
+  }
+
+  //Change points of all pairs, merged per voxel
+  VoxelAccumulator chng_pts(resolutionVox);
   vector<vcg::Shot<float> > shots, newShots;
   vector<string> image_filenames, new_image_filenames;
   vector<CameraT> camera_data, newCameraData;
@@ -217,9 +338,35 @@ void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_pt
   myfile.open("neighbor_cameras.txt");
   myfile2.open("transformation.txt");
 
-  set<int> detected_feat_indeces;
+  //3D points hit by the feature correspondence projection, feature pixels of every camera are indexed once
+  AtomicBitset detected_feats(pt_cam_corr.size());
+  map<int, FeaturePixelIndex> feat_indices;
   set<int> gt_change_indeces;
 
+  //Voxelized model is shared by all ray shooting projections of the run
+  OccupancyGrid::ConstPtr occ_grid;
+  boost::shared_ptr<const DistanceField> dist_field;
+  double query_time = 0;
+
+  long long removed_pts = 0, added_pts = 0;
+  double clean_time = 0;
+
+
+  if(proj_method == RAY_SHOOTING || proj_method == SPHERE_TRACING || proj_method == COMPONENT_RAY_SHOOTING || proj_method == ADAPTIVE_RAY_SHOOTING)
+    occ_grid.reset(new OccupancyGrid(inputStrings[MESH], resolutionVox));
+  if(proj_method == SPHERE_TRACING)
+    dist_field.reset(new DistanceField(*occ_grid));
+
+  //Triangle hierarchy of the old mesh, also shared by all projections
+  MeshBVH::ConstPtr mesh_bvh;
+  if(proj_method == MESH_RAYCAST || proj_method == MESH_RAYCAST_VERTEX)
+    mesh_bvh.reset(new MeshBVH(inputStrings[MESH]));
+
+  //Depth buffers are rendered once per new camera and reused by all its pairs
+  boost::shared_ptr<DepthBufferCache> depth_buffers;
+  if(proj_method == DEPTH_BUFFER)
+    depth_buffers.reset(new DepthBufferCache(inputStrings[MESH]));
+
   for(int i = 0 ; i < newShots.size(); i++){
 
     searchPoint = PclProcessing::vcg2pclPt(newShots[i].Extrinsics.Tra());
@@ -233,6 +380,11 @@ void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_pt
       new_cloud->points[i] = searchPoint;
       cv::Mat newImg(getImg(new_image_filenames[i]));
 
+      //Change masks of all pairs of the new image, all in the frame of the new image
+      vector<cv::Mat> old_imgs(K), pair_masks(K), pair_H(K);
+      vector<ImgFootprint> pair_footprints(K);
+      vector<bool> pair_transposed(K, false);
+
       for(int j = 0 ; j < K ; j++){
 	////////
 	myfile << tmp_vec_vec[i][j] <<"\n";
@@ -251,12 +403,56 @@ void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_pt
 	    continue;
 		
 	//cv::Mat oldImg(nn_imgs[j]);	  
-      	cv::Mat finMask, H;
+	if(ImgProcessing::getImgFundMat(newImg, oldImg, pair_H[j])){
+	  ImgChangeDetector::imgDiffThres(newImg, oldImg, pair_H[j], pair_masks[j], pair_footprints[j]);
+
+	  if(min_area > 0){
+	    int64 t_clean = cv::getTickCount();
+	    int n_removed, n_added;
+	    ImgChangeDetector::cleanMask(pair_masks[j], pair_footprints[j], min_area, n_removed, n_added);
+	    clean_time += double(cv::getTickCount() - t_clean)/cv::getTickFrequency();
+	    removed_pts += n_removed;
+	    added_pts += n_added;
+	    cout<<"Mask clean-up removed points: "<<n_removed<<" added points: "<<n_added<<" img: "<<i<<" neighbour: "<<j<<endl;
+	  }
+	  old_imgs[j] = oldImg;
+	  pair_transposed[j] = transposed;
+	}
+      }
 
-	if(ImgProcessing::getImgFundMat(newImg, oldImg, H)){
+      //With mask consensus only the fused mask is projected, through the pair covering most of the new image
+      int best_j = -1;
+      cv::Mat fused_mask;
+
+      if(fuse_votes > 0){
+	for(int j = 0 ; j < K ; j++)
+	  if(!pair_footprints[j].empty() && (best_j < 0 || pair_footprints[j].area() > pair_footprints[best_j].area()))
+	    best_j = j;
+
+	if(best_j >= 0)
+	  cout<<"Fused change mask points: "<<ImgChangeDetector::fuseMasks(pair_masks, pair_footprints, fuse_votes, fused_mask)<<endl;
+      }
+
+      for(int j = 0 ; j < K ; j++){
+
+	if(fuse_votes > 0 && j != best_j)
+	  continue;
+
+	cv::Mat oldImg(old_imgs[j]);
+	bool transposed = pair_transposed[j];
+      	cv::Mat finMask(pair_masks[j]), H(pair_H[j]);
+	ImgFootprint footprint(pair_footprints[j]), footprint2;
+
+	//Images of the pair do not overlap
+	if(!footprint.empty()){
+
+	  if(fuse_votes > 0){
+	    finMask = fused_mask;
+	    //Triangulated pixels have to be seen by the old camera of the pair
+	    if(proj_method != TRIANGULATION)
+	      footprint = ImgFootprint(finMask.size());
+	  }
 
-	  ImgChangeDetector::imgDiffThres(newImg, oldImg, H, finMask);
-	  
 	  cv::Mat testImg;
 	  cv::Mat fin_mask2;
 	  cv::Mat psaImg;
@@ -270,25 +466,23 @@ void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_pt
 	  //cv::imwrite(tmp_if.str()+"new.jpg", psaImg);
 
 	  warpPerspective(finMask, fin_mask2, H, finMask.size());	  
+	  ImgProcessing::getWarpFootprint(H.inv(), fin_mask2.size(), finMask.size(), footprint2, 0);
 	  
 	  oldImg.copyTo(testImg, 255 - fin_mask2);
 
-	  std::vector<cv::Point2f> mask_pts;
-	  std::vector<cv::Point2f> mask_pts2;
-
-	  ImgIO::getPtsFromMask(fin_mask2, mask_pts);
-	  ImgIO::getPtsFromMask(finMask, mask_pts2);
+	  SpanMask mask_spans(finMask, footprint);
+	  SpanMask mask_spans2(fin_mask2, footprint2);
 
 	  myfile2<<tmp_if.str()+"mask.jpg\n";
 	  cv::imwrite(tmp_if.str()+"mask.jpg", fin_mask2);
 	  cv::imwrite(tmp_if.str()+"mask2.jpg", finMask);
 
-	  cout<<"Change mask detected points: "<<mask_pts.size()<<endl;
+	  cout<<"Change mask detected points: "<<mask_spans2.count()<<endl;
 	  //OVERLAY THE MASK
 	  
 	  /*
-	    for(int g = 0 ; g < mask_pts.size(); g++){
-	    cv::Point2f tmp_pt2 = mask_pts[g];
+	    for(SpanMask::const_iterator g = mask_spans2.begin() ; g != mask_spans2.end(); ++g){
+	    cv::Point2f tmp_pt2 = *g;
 	    testImg.at<cv::Vec3b>(tmp_pt2.y, tmp_pt2.x)[0] = 255;
 	    testImg.at<cv::Vec3b>(tmp_pt2.y, tmp_pt2.x)[1] = 0;
 	    testImg.at<cv::Vec3b>(tmp_pt2.y, tmp_pt2.x)[2] = 0;
@@ -297,35 +491,107 @@ void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_pt
 
 	  switch(proj_method){
 
-	  case 0:
-	    {//TRIANGULATION
+	  case TRIANGULATION:
+	    {
 	      std::cout<<"Projection by triangulation in progress... img: "<<i<<std::endl;
 	      //////////////
-	      cv::Mat mask_3d_pts(ImgIO::projChngMaskTo3D(finMask, newShots[i], shots[img_idx_map[tmp_vec_vec[i][j]]], H));
+	      std::vector<vcg::Point3f> tmp_vec_pts;
+	      ImgIO::projChngMaskTo3D(mask_spans, newShots[i], shots[img_idx_map[tmp_vec_vec[i][j]]], H, tmp_vec_pts);
 	      ////////////////
 
 	      //  cv::Mat mask_3d_pts(ImgIO::projChngMaskTo3D(finMask, newShots[i], shots[pointIdxNKNSearch[0]], H));
-	      std::vector<vcg::Point3f> tmp_vec_pts;
-	      DataProcessing::cvt3Dmat2vcg(mask_3d_pts, tmp_vec_pts);		    
-	      tmp_3d_masks.push_back(tmp_vec_pts);
+	      chng_pts.add(tmp_vec_pts);
 	      break;
 	    }
-	  case 1: 	    	    
-	    // RAY SHOOTING
-	    tmp_3d_masks.push_back(ImgIO::projChngMask(inputStrings[MESH], finMask, newShots[i], resolutionVox));
+	  case RAY_SHOOTING:
+	    {
+	      std::cout<<"Projection by ray shooting in progress... img: "<<i<<std::endl;
+	      RayCaster caster(*occ_grid);
+	      std::vector<int> hit_idx, ray_steps;
+	      caster.castMask(mask_spans, newShots[i], hit_idx, ray_steps);
+	      chng_pts.add(caster.getHitPoints(hit_idx));
+	    }
 	    break;
 	    
-	  case 2:
-	    {// POINT CORRESPONDENCES
+	  case SPHERE_TRACING:
+	    {
+	      std::cout<<"Projection by sphere tracing in progress... img: "<<i<<std::endl;
+	      RayCaster caster(*occ_grid);
+	      caster.setDistanceField(dist_field.get());
+	      std::vector<int> hit_idx, ray_steps;
+	      int64 t_start = cv::getTickCount();
+	      caster.castMask(mask_spans, newShots[i], hit_idx, ray_steps);
+	      query_time += double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+	      chng_pts.add(caster.getHitPoints(hit_idx));
+	    }
+	    break;
+
+	  case COMPONENT_RAY_SHOOTING:
+	    {
+	      std::cout<<"Projection by component ray shooting in progress... img: "<<i<<std::endl;
+	      RayCaster caster(*occ_grid);
+	      std::vector<int> hit_idx;
+	      int64 t_start = cv::getTickCount();
+	      int n_rays = caster.castComponents(mask_spans, newShots[i], hit_idx);
+	      query_time += double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+	      std::cout<<"Rays shot: "<<n_rays<<" for "<<mask_spans.count()<<" mask pixels, voxels reached: "<<hit_idx.size()<<std::endl;
+	      chng_pts.add(caster.getHitPoints(hit_idx));
+	    }
+	    break;
+
+	  case ADAPTIVE_RAY_SHOOTING:
+	    {
+	      std::cout<<"Projection by adaptive ray shooting in progress... img: "<<i<<std::endl;
+	      RayCaster caster(*occ_grid);
+	      std::vector<int> hit_idx;
+	      int64 t_start = cv::getTickCount();
+	      int n_rays = caster.castAdaptive(mask_spans, newShots[i], hit_idx, ray_stride, ray_depth);
+	      query_time += double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+	      std::cout<<"Rays shot: "<<n_rays<<" for "<<mask_spans.count()<<" mask pixels, voxels reached: "<<hit_idx.size()<<std::endl;
+	      chng_pts.add(caster.getHitPoints(hit_idx));
+	    }
+	    break;
+
+	  case MESH_RAYCAST:
+	  case MESH_RAYCAST_VERTEX:
+	    {
+	      std::cout<<"Projection by mesh ray casting in progress... img: "<<i<<std::endl;
+	      std::vector<vcg::Point3f> tmp_vec_pts;
+	      int64 t_start = cv::getTickCount();
+	      mesh_bvh->castMask(mask_spans, newShots[i], tmp_vec_pts, proj_method == MESH_RAYCAST_VERTEX);
+	      query_time += double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+	      chng_pts.add(tmp_vec_pts);
+	    }
+	    break;
+
+	  case DEPTH_BUFFER:
+	    {
+	      std::cout<<"Projection by depth buffer lookup in progress... img: "<<i<<std::endl;
+	      DepthBuffer::ConstPtr depth_buffer = depth_buffers->get(i, newShots[i]);
+	      std::vector<vcg::Point3f> tmp_vec_pts;
+	      int64 t_start = cv::getTickCount();
+	      depth_buffer->lookupMask(mask_spans, tmp_vec_pts);
+	      query_time += double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+	      chng_pts.add(tmp_vec_pts);
+	    }
+	    break;
+
+	  case FEATURE_CORRESPONDENCE:
+	    {
 	      std::cout<<"Projection through point correspondences in progress... img: "<<i<<std::endl;
 	      int old_img_idx = img_idx_map[tmp_vec_vec[i][j]];
-	      tmp_3d_masks.push_back(ImgIO::projChngMaskCorr(fin_mask2, tmp_cam_feat_map[old_img_idx], pt_cam_corr, detected_feat_indeces));
+	      //Masks are zero outside of their footprints, feature pixels are read directly
+	      std::vector<vcg::Point3f> old_pts, new_pts;
+	      ImgIO::projChngMaskCorr(fin_mask2, getFeatureIndex(feat_indices, tmp_cam_feat_map, old_img_idx, fin_mask2.size()), pt_cam_corr, detected_feats, old_pts);
 
 	      if(transposed){
 		cv::transpose(finMask,finMask);
 		cv::flip(finMask,finMask,1);
 	      }
-	      tmp_3d_masks.push_back(ImgIO::projChngMaskCorr(finMask, tmp_cam_feat_map[start_idx+i], pt_cam_corr, detected_feat_indeces));
+	      ImgIO::projChngMaskCorr(finMask, getFeatureIndex(feat_indices, tmp_cam_feat_map, start_idx+i, finMask.size()), pt_cam_corr, detected_feats, new_pts);
+	      //Points seen in both images of the pair vote once
+	      old_pts.insert(old_pts.end(), new_pts.begin(), new_pts.end());
+	      chng_pts.add(old_pts);
 	    }
 	    break;	 
 	  }
@@ -334,12 +600,22 @@ void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_pt
     }
   }
 
-  cout<<"Total detected unique change points:"<<detected_feat_indeces.size()<<endl;
-  cout<<"TN: "<<tmp_pt_cam_corr.size()-detected_feat_indeces.size()<<endl;
+  cout<<"Total detected unique change points:"<<detected_feats.count()<<endl;
+  cout<<"TN: "<<tmp_pt_cam_corr.size()-detected_feats.count()<<endl;
+  if(dist_field)
+    cout<<"Distance field build time: "<<dist_field->getBuildTime()<<" s, total query time: "<<query_time<<" s"<<endl;
+  if(proj_method == COMPONENT_RAY_SHOOTING || proj_method == ADAPTIVE_RAY_SHOOTING)
+    cout<<"Total ray shooting time: "<<query_time<<" s"<<endl;
+  if(mesh_bvh)
+    cout<<"Mesh BVH build time: "<<mesh_bvh->getBuildTime()<<" s, total query time: "<<query_time<<" s"<<endl;
+  if(depth_buffers)
+    cout<<depth_buffers->size()<<" depth buffers rendered in "<<depth_buffers->getRenderTime()<<" s, total lookup time: "<<query_time<<" s"<<endl;
+  if(min_area > 0)
+    cout<<"Mask clean-up removed "<<removed_pts<<" points, added "<<added_pts<<" points in "<<clean_time<<" s"<<endl;
   myfile.close();
   myfile2.close();
-  vector<vcg::Color4b> pts_colors(0);
-  MeshIO::saveChngMask3d(tmp_3d_masks, pts_colors, "change_mask.ply");
+  MeshIO::saveChngMask3d(chng_pts, "change_mask.ply");
+  cout<<"Image difference pipeline time: "<<double(cv::getTickCount() - t_pipeline)/cv::getTickFrequency()<<" s"<<endl;
 }
 
 /**
@@ -477,9 +753,23 @@ void pipelinePSA(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::Poi
   MeshIO::saveChngMask3d(tmp_3d_masks, pts_colors, "change_mask.ply");
 }
 
+/**
+   Function returns single channel version of the mask, masks already in this format are shared without copy
+*/
+static cv::Mat getGrayMask(const cv::Mat &mask){
+
+  if(mask.type() == CV_8UC1)
+    return mask;
+
+  cv::Mat gray_mask;
+  cv::cvtColor(mask, gray_mask, CV_BGR2GRAY);
+  return gray_mask;
+}
+
 void generateGTcloud(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > new_cloud, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > view_points, int proj_method, double resolutionVox){
 
-  vector<vector<vcg::Point3f> > tmp_3d_masks;
+  //Change points of all pairs, merged per voxel
+  VoxelAccumulator chng_pts(resolutionVox);
   vector<string> image_filenames, new_image_filenames;
 
   vector<string> new_gt_filenames, old_gt_filenames;
@@ -500,7 +790,8 @@ void generateGTcloud(map<int,string> inputStrings, int K, boost::shared_ptr<pcl:
   FileIO::readNewFiles(inputStrings[1], new_gt_filenames);
   FileIO::readNewFiles(inputStrings[2], old_gt_filenames);
 
-  set<int> detected_feat_indeces;
+  AtomicBitset detected_feats(pt_cam_corr.size());
+  map<int, FeaturePixelIndex> feat_indices;
   
   ifstream in_stream(inputStrings[3].c_str());
   int new_img_start_idx = 0;
@@ -509,24 +800,27 @@ void generateGTcloud(map<int,string> inputStrings, int K, boost::shared_ptr<pcl:
 
   for(int i = 0 ; i < new_gt_filenames.size(); i++){
     
-    cv::Mat newImg(getImg(new_gt_filenames[i]));         
-    cv::Mat oldImg(getImg(old_gt_filenames[i]));
+    cv::Mat newImg(getGrayMask(getImg(new_gt_filenames[i])));         
+    cv::Mat oldImg(getGrayMask(getImg(old_gt_filenames[i])));
       
     int old_img_idx;
     in_stream>>old_img_idx;
       
-    tmp_3d_masks.push_back(ImgIO::projChngMaskCorr(newImg, tmp_cam_feat_map[new_img_start_idx+i], pt_cam_corr, detected_feat_indeces));         
-    tmp_3d_masks.push_back(ImgIO::projChngMaskCorr(oldImg, tmp_cam_feat_map[old_img_idx], pt_cam_corr, detected_feat_indeces));	   			
+    vector<vcg::Point3f> new_pts, old_pts;
+    ImgIO::projChngMaskCorr(newImg, getFeatureIndex(feat_indices, tmp_cam_feat_map, new_img_start_idx+i, newImg.size()), pt_cam_corr, detected_feats, new_pts);
+    ImgIO::projChngMaskCorr(oldImg, getFeatureIndex(feat_indices, tmp_cam_feat_map, old_img_idx, oldImg.size()), pt_cam_corr, detected_feats, old_pts);
+    new_pts.insert(new_pts.end(), old_pts.begin(), old_pts.end());
+    chng_pts.add(new_pts);
   }
     
-  cout<<"Total detected unique change points:"<<detected_feat_indeces.size()<<endl;
-  vector<vcg::Color4b> pts_colors(0);
-  MeshIO::saveChngMask3d(tmp_3d_masks, pts_colors, "gt_cloud.ply");
+  cout<<"Total detected unique change points:"<<detected_feats.count()<<endl;
+  MeshIO::saveChngMask3d(chng_pts, "gt_cloud.ply");
 }
 
 void usePSMmasks(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > new_cloud, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > view_points, int proj_method, double resolutionVox){
 
-  vector<vector<vcg::Point3f> > tmp_3d_masks;
+  //Change points of all pairs, merged per voxel
+  VoxelAccumulator chng_pts(resolutionVox);
   vector<string> image_filenames, new_image_filenames;
 
   vector<string> new_gt_filenames, old_gt_filenames;
@@ -544,7 +838,8 @@ void usePSMmasks(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::Poi
 
   FileIO::readNewFiles(inputStrings[1], new_gt_filenames);
 
-  set<int> detected_feat_indeces;
+  AtomicBitset detected_feats(pt_cam_corr.size());
+  map<int, FeaturePixelIndex> feat_indices;
   
   ifstream in_stream(inputStrings[3].c_str());
   int new_img_start_idx = 0;
@@ -555,24 +850,26 @@ void usePSMmasks(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::Poi
     int old_img_idx;
     in_stream>>old_img_idx;
 
-    cv::Mat newImg(getImg(new_gt_filenames[i]));                     
+    cv::Mat newImg(getGrayMask(getImg(new_gt_filenames[i])));                     
     cv::Mat newImg1(getImg(tmp_image_filenames[new_img_start_idx+1]));                     
     cv::Mat oldImg(getImg(tmp_image_filenames[old_img_idx]));
 
     cv::Mat H;
+    //Points of the old and the new image, projected points append to the same vector
+    vector<vcg::Point3f> new_pts;
 
     if(ImgProcessing::getImgFundMat(newImg1, oldImg, H)){
       cv::Mat mask2;
       warpPerspective(newImg, mask2, H, newImg.size());
-      tmp_3d_masks.push_back(ImgIO::projChngMaskCorr(mask2, tmp_cam_feat_map[old_img_idx], pt_cam_corr, detected_feat_indeces));         
+      ImgIO::projChngMaskCorr(mask2, getFeatureIndex(feat_indices, tmp_cam_feat_map, old_img_idx, mask2.size()), pt_cam_corr, detected_feats, new_pts);
     }        
-    tmp_3d_masks.push_back(ImgIO::projChngMaskCorr(newImg, tmp_cam_feat_map[new_img_start_idx+i], pt_cam_corr, detected_feat_indeces));         
+    ImgIO::projChngMaskCorr(newImg, getFeatureIndex(feat_indices, tmp_cam_feat_map, new_img_start_idx+i, newImg.size()), pt_cam_corr, detected_feats, new_pts);
+    chng_pts.add(new_pts);
   }
     
-  cout<<"Total detected unique change points:"<<detected_feat_indeces.size()<<endl;
-  cout<<"TN: "<<pt_cam_corr.size()-detected_feat_indeces.size()<<endl;
-  vector<vcg::Color4b> pts_colors(0);
-  MeshIO::saveChngMask3d(tmp_3d_masks, pts_colors, "change_mask.ply");
+  cout<<"Total detected unique change points:"<<detected_feats.count()<<endl;
+  cout<<"TN: "<<pt_cam_corr.size()-detected_feats.count()<<endl;
+  MeshIO::saveChngMask3d(chng_pts, "change_mask.ply");
 }
 
 //////////////////////// UNFINISHED VISIBILITY ESTIMATION ////////////////////////////////////////////
@@ -647,3 +944,173 @@ void usePSMmasks(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::Poi
   }
 */
 
+/**
+   Function compares the scalar ray shooting projection with the packet ray caster on a single change mask, with and without skipping of empty bricks. Inputs are the model (MESH), cameras (NVM) and binary mask image (MASKIMG) of camera cam_idx.
+*/
+void benchmarkRayShooting(map<int,string> inputStrings, int cam_idx, double resolutionVox){
+
+  vector<CameraT> camera_data;
+  vector<string> image_filenames;
+  vector<PtCamCorr> pt_cam_corr;
+  map<int, vector<ImgFeature> > cam_feat_map;
+
+  FileIO::getNVM(inputStrings[NVM], camera_data, image_filenames, pt_cam_corr, cam_feat_map);
+  vector<vcg::Shot<float> > shots = FileIO::nvmCam2vcgShot(camera_data, image_filenames);
+
+  if(cam_idx < 0 || cam_idx >= shots.size()){
+    std::cout<<"Camera index "<<cam_idx<<" out of range"<<std::endl;
+    return;
+  }
+
+  cv::Mat mask_img = cv::imread(inputStrings[MASKIMG], 0);
+  if(mask_img.empty()){
+    std::cout<<"Could not read mask "<<inputStrings[MASKIMG]<<std::endl;
+    return;
+  }
+  cv::threshold(mask_img, mask_img, 127, 255, cv::THRESH_BINARY);
+
+  SpanMask mask_spans(mask_img);
+  OccupancyGrid grid(inputStrings[MESH], resolutionVox);
+  RayCaster caster(grid);
+
+  std::cout<<"Rays: "<<mask_spans.count()<<std::endl;
+
+  int64 t_start = cv::getTickCount();
+  std::vector<vcg::Point3f> ref_pts = ImgIO::projChngMask(grid, mask_spans, shots[cam_idx]);
+  double t_ref = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+  std::cout<<"projChngMask: "<<t_ref<<" s, hits: "<<ref_pts.size()<<std::endl;
+
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+
+  vector<int> thread_counts;
+  for(int t = 1 ; t < max_threads ; t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  for(int tc = 0 ; tc < thread_counts.size() ; tc++){
+
+    int threads = thread_counts[tc];
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    std::vector<int> hit_idx, ray_steps, ray_bricks;
+
+    t_start = cv::getTickCount();
+    caster.castMask(mask_spans, shots[cam_idx], hit_idx, ray_steps, &ray_bricks);
+    double t_cast = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+    std::vector<vcg::Point3f> cast_pts = caster.getHitPoints(hit_idx);
+
+    long long total_steps = 0, total_bricks = 0;
+    for(int r = 0 ; r < ray_steps.size() ; r++){
+      total_steps += ray_steps[r];
+      total_bricks += ray_bricks[r];
+    }
+
+    int mismatches = std::abs(int(cast_pts.size()) - int(ref_pts.size()));
+    for(int p = 0 ; p < std::min(cast_pts.size(), ref_pts.size()) ; p++)
+      if(!(cast_pts[p] == ref_pts[p]))
+	mismatches++;
+
+    std::cout<<"RayCaster, "<<threads<<" threads: "<<t_cast<<" s, speedup "<<t_ref/t_cast
+	     <<", hits: "<<cast_pts.size()<<", mismatches: "<<mismatches
+	     <<", avg voxels per ray: "<<double(total_steps)/std::max<std::size_t>(ray_steps.size(), 1)
+	     <<", avg skipped bricks per ray: "<<double(total_bricks)/std::max<std::size_t>(ray_bricks.size(), 1)<<std::endl;
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(max_threads);
+#endif
+
+  // same rays without the brick level, every voxel along the ray is visited
+  RayCaster flat_caster(grid, false);
+  std::vector<int> flat_idx, flat_steps;
+
+  t_start = cv::getTickCount();
+  flat_caster.castMask(mask_spans, shots[cam_idx], flat_idx, flat_steps);
+  double t_flat = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+  long long total_flat_steps = 0;
+  for(int r = 0 ; r < flat_steps.size() ; r++)
+    total_flat_steps += flat_steps[r];
+
+  std::cout<<"RayCaster without brick skipping, "<<max_threads<<" threads: "<<t_flat<<" s, hits: "<<flat_caster.getHitPoints(flat_idx).size()
+	   <<", avg voxels per ray: "<<double(total_flat_steps)/std::max<std::size_t>(flat_steps.size(), 1)<<std::endl;
+
+  // sphere tracing trades the distance transform build for shorter marches
+  DistanceField dist_field(grid);
+  RayCaster sphere_caster(grid);
+  sphere_caster.setDistanceField(&dist_field);
+  std::vector<int> sphere_idx, sphere_steps;
+
+  t_start = cv::getTickCount();
+  sphere_caster.castMask(mask_spans, shots[cam_idx], sphere_idx, sphere_steps);
+  double t_sphere = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+  long long total_sphere_steps = 0;
+  for(int r = 0 ; r < sphere_steps.size() ; r++)
+    total_sphere_steps += sphere_steps[r];
+
+  std::cout<<"Sphere tracing, "<<max_threads<<" threads: build "<<dist_field.getBuildTime()<<" s, query "<<t_sphere<<" s, hits: "<<sphere_caster.getHitPoints(sphere_idx).size()
+	   <<", avg voxels per ray: "<<double(total_sphere_steps)/std::max<std::size_t>(sphere_steps.size(), 1)<<std::endl;
+
+  // adaptive casting trades rays for voxels missed or added against shooting every pixel
+  std::set<int> ref_voxels;
+  for(int r = 0 ; r < flat_idx.size() ; r++)
+    if(flat_idx[r] != -1)
+      ref_voxels.insert(flat_idx[r]);
+
+  vector<int> strides, depths;
+  if(inputStrings.count(RAYSTRIDE)){
+    int ray_stride = RayCaster::SAMPLE_STRIDE, ray_depth = RayCaster::REFINE_DEPTH;
+    if(!getIntArg(inputStrings, RAYSTRIDE, ray_stride) || ray_stride < 1 || !getIntArg(inputStrings, RAYDEPTH, ray_depth) || ray_depth < 0){
+      cout<<"Ray shooting stride has to be a positive and refinement depth a non-negative integer"<<endl;
+      return;
+    }
+    strides.push_back(ray_stride);
+    depths.push_back(ray_depth);
+  }
+  else
+    for(int stride = 4 ; stride <= 16 ; stride *= 2)
+      for(int depth = 0 ; (1 << depth) <= stride ; depth++){
+	strides.push_back(stride);
+	depths.push_back(depth);
+      }
+
+  for(int a = 0 ; a < strides.size() ; a++){
+
+    std::vector<int> adaptive_idx;
+
+    t_start = cv::getTickCount();
+    int n_rays = caster.castAdaptive(mask_spans, shots[cam_idx], adaptive_idx, strides[a], depths[a]);
+    double t_adaptive = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+    int common_voxels = 0;
+    for(int v = 0 ; v < adaptive_idx.size() ; v++)
+      common_voxels += ref_voxels.count(adaptive_idx[v]);
+
+    std::cout<<"Adaptive casting, stride "<<strides[a]<<", depth "<<depths[a]<<": "<<t_adaptive<<" s, rays: "<<n_rays
+	     <<" ("<<100.0*n_rays/std::max<std::size_t>(mask_spans.count(), 1)<<"%), voxels: "<<adaptive_idx.size()
+	     <<", missed: "<<ref_voxels.size() - common_voxels<<", added: "<<adaptive_idx.size() - common_voxels<<std::endl;
+  }
+}
+
+/**
+   Function compares the serial and parallel max-flow solvers of the MRF stage on the model (MESH) and the change mask cloud (CHANGEMASK)
+*/
+void benchmarkMaxflow(map<int,string> inputStrings, double resolution, const double &alpha){
+
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud2(new pcl::PointCloud<pcl::PointXYZRGBA>);
+
+  std::vector<int> votes;
+
+  getPlyFilePCL(inputStrings[MESH], cloud);
+  MeshIO::getChngMaskVotes(inputStrings[CHANGEMASK], cloud2, votes);
+
+  MeshChangeDetector::benchmarkMaxflow(cloud, cloud2, votes, resolution, alpha);
+}
@@ -12,6 +12,11 @@
 
 using namespace std;
 
+// Techniques projecting the 2D change masks into 3D, index of the GUI combo box
+enum projection_method{TRIANGULATION, RAY_SHOOTING, FEATURE_CORRESPONDENCE, SPHERE_TRACING, MESH_RAYCAST, MESH_RAYCAST_VERTEX, DEPTH_BUFFER, COMPONENT_RAY_SHOOTING, ADAPTIVE_RAY_SHOOTING};
+// Feature grouping of the correspondence pipeline, all features at once or updated camera by camera
+enum feature_grouping{BATCH_GROUPING, INCREMENTAL_GROUPING};
+
 void energyMin(map<int,string> input_strings, double, const double&);
 void pipelineImgDifference(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> >, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> >, int, double);
 void pipelineCorrespondences(map<int,string> inputStrings, int K, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> >, boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> >);
@@ -20,4 +25,7 @@ void pipelinePSA(map<int,string> , int, boost::shared_ptr<pcl::PointCloud<pcl::P
 void usePSMmasks(map<int,string>, int , boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > , boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > , int, double);
 
 void generateGTcloud(map<int,string>, int , boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > , boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> > , int, double);
+
+void benchmarkRayShooting(map<int,string>, int, double);
+void benchmarkMaxflow(map<int,string>, double, const double&);
 #endif
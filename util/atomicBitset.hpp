@@ -0,0 +1,51 @@
+#ifndef __ATOMICBITSET_H_INCLUDED__
+#define __ATOMICBITSET_H_INCLUDED__
+
+#include <set>
+#include <vector>
+#include <cstddef>
+
+/**
+   Fixed size bitset whose bits can be set concurrently from several threads. Used to record detected 3D points by their index instead of inserting them into a shared std::set.
+*/
+class AtomicBitset{
+
+public:
+  static const int WORD_BITS = 32;
+
+  AtomicBitset() : n_bits(0){}
+  explicit AtomicBitset(std::size_t size) : n_bits(size), words((size + WORD_BITS - 1) / WORD_BITS, 0){}
+
+  /**
+     Function sets the bit and returns true if it was not set before
+  */
+  bool set(std::size_t i){
+    unsigned int mask = 1u << (i % WORD_BITS);
+    return (__sync_fetch_and_or(&words[i / WORD_BITS], mask) & mask) == 0;
+  }
+
+  bool test(std::size_t i) const {return (words[i / WORD_BITS] >> (i % WORD_BITS)) & 1u;}
+  std::size_t size() const {return n_bits;}
+
+  std::size_t count() const{
+    std::size_t total = 0;
+    for(std::size_t w = 0 ; w < words.size() ; w++)
+      total += __builtin_popcount(words[w]);
+    return total;
+  }
+
+  /**
+     Function inserts indices of all set bits into out_set
+  */
+  void toSet(std::set<int> &out_set) const{
+    for(std::size_t w = 0 ; w < words.size() ; w++)
+      for(unsigned int bits = words[w] ; bits != 0 ; bits &= bits - 1)
+	out_set.insert(int(w*WORD_BITS + __builtin_ctz(bits)));
+  }
+
+private:
+  std::size_t n_bits;
+  std::vector<unsigned int> words;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "camVisibility.hpp"
+
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+   Function builds the bitsets from the point-camera correspondences. Camera count is taken from the correspondences when n_cams is not large enough.
+*/
+CamVisibility::CamVisibility(const std::vector<PtCamCorr> &pts_corr, int in_n_cams) : n_pts(pts_corr.size()), n_cams(in_n_cams){
+
+  for(int i = 0 ; i < n_pts ; i++)
+    for(int j = 0 ; j < pts_corr[i].camidx.size() ; j++)
+      n_cams = std::max(n_cams, pts_corr[i].camidx[j] + 1);
+
+  n_words = std::max((n_cams + WORD_BITS - 1) / WORD_BITS, 1);
+  bits.assign(static_cast<std::size_t>(n_pts)*n_words, 0);
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0 ; i < n_pts ; i++){
+    Word *pt_bits = &bits[static_cast<std::size_t>(i)*n_words];
+    for(int j = 0 ; j < pts_corr[i].camidx.size() ; j++){
+      int cam = pts_corr[i].camidx[j];
+      if(cam >= 0)
+	pt_bits[cam / WORD_BITS] |= Word(1) << (cam % WORD_BITS);
+    }
+  }
+}
+
+/**
+   Function returns the bitset of the cameras of the set, cameras outside of the reconstruction are ignored
+*/
+CamVisibility::CameraSet CamVisibility::makeCameraSet(const std::set<int> &cam_idx) const{
+
+  CameraSet cams(n_words, 0);
+
+  for(std::set<int>::const_iterator it = cam_idx.begin() ; it != cam_idx.end() ; ++it)
+    if(*it >= 0 && *it < n_cams)
+      cams[*it / WORD_BITS] |= Word(1) << (*it % WORD_BITS);
+
+  return cams;
+}
+
+/**
+   Function returns the bitset of cameras [first, last), e.g. the cameras added after some point in time
+*/
+CamVisibility::CameraSet CamVisibility::makeCameraRange(int first, int last) const{
+
+  CameraSet cams(n_words, 0);
+
+  for(int cam = std::max(first, 0) ; cam < std::min(last, n_cams) ; cam++)
+    cams[cam / WORD_BITS] |= Word(1) << (cam % WORD_BITS);
+
+  return cams;
+}
+
+/**
+   Function returns the number of cameras observing the point
+*/
+int CamVisibility::count(int pt) const{
+
+  const Word *pt_bits = &bits[static_cast<std::size_t>(pt)*n_words];
+  int total = 0;
+
+  for(int w = 0 ; w < n_words ; w++)
+    total += __builtin_popcountll(pt_bits[w]);
+
+  return total;
+}
+
+/**
+   Function returns the number of cameras of the set observing the point
+*/
+int CamVisibility::countIn(int pt, const CameraSet &cams) const{
+
+  const Word *pt_bits = &bits[static_cast<std::size_t>(pt)*n_words];
+  int total = 0;
+
+  for(int w = 0 ; w < n_words ; w++)
+    total += __builtin_popcountll(pt_bits[w] & cams[w]);
+
+  return total;
+}
+
+/**
+   Function checks whether any camera of the set observes the point
+*/
+bool CamVisibility::intersects(int pt, const CameraSet &cams) const{
+
+  const Word *pt_bits = &bits[static_cast<std::size_t>(pt)*n_words];
+
+  for(int w = 0 ; w < n_words ; w++)
+    if(pt_bits[w] & cams[w])
+      return true;
+
+  return false;
+}
+
+/**
+   Function marks the points observed by at least one camera of any_of and by no camera of none_of. An empty any_of set selects every point not observed by none_of.
+*/
+void CamVisibility::select(const CameraSet &any_of, const CameraSet &none_of, std::vector<unsigned char> &flags) const{
+
+  flags.assign(n_pts, 0);
+
+  const bool any_empty = std::count(any_of.begin(), any_of.end(), Word(0)) == any_of.size();
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0 ; i < n_pts ; i++){
+
+    const Word *pt_bits = &bits[static_cast<std::size_t>(i)*n_words];
+    Word seen = 0, excluded = 0;
+    int w = 0;
+
+#ifdef __AVX2__
+    __m256i seen_v = _mm256_setzero_si256();
+    __m256i excluded_v = _mm256_setzero_si256();
+
+    for(; w + 4 <= n_words ; w += 4){
+      __m256i v = _mm256_loadu_si256((const __m256i*)(pt_bits + w));
+      seen_v = _mm256_or_si256(seen_v, _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*)(&any_of[w]))));
+      excluded_v = _mm256_or_si256(excluded_v, _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*)(&none_of[w]))));
+    }
+
+    seen = _mm256_testz_si256(seen_v, seen_v) ? 0 : 1;
+    excluded = _mm256_testz_si256(excluded_v, excluded_v) ? 0 : 1;
+#endif
+
+    for(; w < n_words ; w++){
+      seen |= pt_bits[w] & any_of[w];
+      excluded |= pt_bits[w] & none_of[w];
+    }
+
+    flags[i] = (any_empty || seen != 0) && excluded == 0;
+  }
+}
+
+/**
+   Function writes indices of the selected points in increasing order, see select above
+*/
+void CamVisibility::select(const CameraSet &any_of, const CameraSet &none_of, std::vector<int> &out_pts) const{
+
+  std::vector<unsigned char> flags;
+  select(any_of, none_of, flags);
+
+  out_pts.clear();
+  for(int i = 0 ; i < n_pts ; i++)
+    if(flags[i])
+      out_pts.push_back(i);
+}
@@ -0,0 +1,42 @@
+#ifndef __CAMVISIBILITY_H_INCLUDED__
+#define __CAMVISIBILITY_H_INCLUDED__
+
+#include <set>
+#include <vector>
+
+#include "../common/common.hpp"
+
+/**
+   Cameras observing every 3D point of the reconstruction as fixed width bitsets, one bit per camera and WORD_BITS cameras per word. Bitsets of all points are stored in a single array, so questions about camera sets ("seen by some of these cameras and by none of those") are answered with AND/ANDNOT over whole words, four words at once with AVX2 when available.
+*/
+class CamVisibility{
+
+public:
+  static const int WORD_BITS = 64;
+  typedef unsigned long long Word;
+  typedef std::vector<Word> CameraSet;
+
+  CamVisibility(const std::vector<PtCamCorr> &pts_corr, int n_cams = 0);
+
+  int size() const {return n_pts;}
+  int getCameraCount() const {return n_cams;}
+
+  CameraSet makeCameraSet(const std::set<int> &cam_idx) const;
+  CameraSet makeCameraRange(int first, int last) const;
+
+  int count(int pt) const;
+  int countIn(int pt, const CameraSet &cams) const;
+  bool intersects(int pt, const CameraSet &cams) const;
+
+  void select(const CameraSet &any_of, const CameraSet &none_of, std::vector<unsigned char> &flags) const;
+  void select(const CameraSet &any_of, const CameraSet &none_of, std::vector<int> &out_pts) const;
+
+private:
+  int n_pts;
+  int n_cams;
+  int n_words;
+  //Bitset of point i occupies words [i*n_words, (i+1)*n_words)
+  std::vector<Word> bits;
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "depthBuffer.hpp"
+#include "spanMask.hpp"
+#include "utilIO.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+#include <opencv2/core/core.hpp>
+
+DepthBuffer::DepthBuffer(const MeshGeometry &in_mesh, const vcg::Shot<float> &in_shot, int in_downscale) : mesh(in_mesh), shot(in_shot), downscale(std::max(1, in_downscale)), render_time(0){
+
+  origin = shot.Extrinsics.Tra();
+  view_axis = shot.UnProject(vcg::Point2f(shot.Intrinsics.CenterPx[0], shot.Intrinsics.CenterPx[1]), 1) - origin;
+  view_axis = view_axis / view_axis.Norm();
+
+  width = (shot.Intrinsics.ViewportPx[0] + downscale - 1) / downscale;
+  height = (shot.Intrinsics.ViewportPx[1] + downscale - 1) / downscale;
+
+  render();
+}
+
+/**
+   Function rasterizes all faces into the buffer. Faces are binned into bands of BAND_ROWS rows and the bands are filled in parallel, so no two threads write the same cell. Depth is interpolated perspective correctly through its inverse.
+*/
+void DepthBuffer::render(){
+
+  int64 t_start = cv::getTickCount();
+
+  depth.assign(width*height, FLT_MAX);
+  face_idx.assign(width*height, -1);
+
+  const int n_verts = mesh.vertices.size();
+  const int n_faces = mesh.getFaceCount();
+
+  // vertices in buffer coordinates, cell centers lie on integer positions
+  std::vector<float> px(n_verts), py(n_verts), pz(n_verts);
+  const float offset = 0.5f*(downscale - 1);
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0 ; i < n_verts ; i++){
+    vcg::Point2f p = shot.Project(mesh.vertices[i]);
+    px[i] = (p[0] - offset) / downscale;
+    py[i] = (p[1] - offset) / downscale;
+    pz[i] = (mesh.vertices[i] - origin) * view_axis;
+  }
+
+  const int n_bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+  std::vector<std::vector<int> > band_faces(n_bands);
+
+  for(int f = 0 ; f < n_faces ; f++){
+    const int *tri = &mesh.faces[3*f];
+
+    // faces crossing the image plane are not rendered
+    if(pz[tri[0]] <= 0 || pz[tri[1]] <= 0 || pz[tri[2]] <= 0)
+      continue;
+
+    float x_min = std::min(px[tri[0]], std::min(px[tri[1]], px[tri[2]]));
+    float x_max = std::max(px[tri[0]], std::max(px[tri[1]], px[tri[2]]));
+    float y_min = std::min(py[tri[0]], std::min(py[tri[1]], py[tri[2]]));
+    float y_max = std::max(py[tri[0]], std::max(py[tri[1]], py[tri[2]]));
+
+    if(x_max < 0 || y_max < 0 || x_min > width - 1 || y_min > height - 1)
+      continue;
+
+    int first_band = std::max(0, int(std::ceil(y_min))) / BAND_ROWS;
+    int last_band = std::min(height - 1, int(std::floor(y_max))) / BAND_ROWS;
+    for(int b = first_band ; b <= last_band ; b++)
+      band_faces[b].push_back(f);
+  }
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int b = 0 ; b < n_bands ; b++){
+
+    const int band_first = b*BAND_ROWS;
+    const int band_last = std::min(height, band_first + BAND_ROWS) - 1;
+
+    for(int k = 0 ; k < band_faces[b].size() ; k++){
+
+      const int f = band_faces[b][k];
+      const int *tri = &mesh.faces[3*f];
+      const float x0 = px[tri[0]], y0 = py[tri[0]];
+      const float x1 = px[tri[1]], y1 = py[tri[1]];
+      const float x2 = px[tri[2]], y2 = py[tri[2]];
+
+      const float area = (x1 - x0)*(y2 - y0) - (x2 - x0)*(y1 - y0);
+      if(std::fabs(area) < 1e-12f)
+	continue;
+
+      const float inv_area = 1.0f/area;
+      const float iz0 = 1.0f/pz[tri[0]], iz1 = 1.0f/pz[tri[1]], iz2 = 1.0f/pz[tri[2]];
+
+      int c_first = std::max(0, int(std::ceil(std::min(x0, std::min(x1, x2)))));
+      int c_last = std::min(width - 1, int(std::floor(std::max(x0, std::max(x1, x2)))));
+      int r_first = std::max(band_first, int(std::ceil(std::min(y0, std::min(y1, y2)))));
+      int r_last = std::min(band_last, int(std::floor(std::max(y0, std::max(y1, y2)))));
+
+      // barycentric coordinates are linear in the column, step them along the row
+      const float db0 = (y1 - y2)*inv_area, db1 = (y2 - y0)*inv_area, db2 = (y0 - y1)*inv_area;
+
+      for(int r = r_first ; r <= r_last ; r++){
+
+	float b0 = ((x1 - c_first)*(y2 - r) - (x2 - c_first)*(y1 - r))*inv_area;
+	float b1 = ((x2 - c_first)*(y0 - r) - (x0 - c_first)*(y2 - r))*inv_area;
+	float b2 = 1.0f - b0 - b1;
+
+	float *depth_row = &depth[r*width];
+	int *face_row = &face_idx[r*width];
+
+	for(int c = c_first ; c <= c_last ; c++, b0 += db0, b1 += db1, b2 += db2){
+
+	  if(b0 < -1e-5f || b1 < -1e-5f || b2 < -1e-5f)
+	    continue;
+
+	  float z = 1.0f/(b0*iz0 + b1*iz1 + b2*iz2);
+	  if(z < depth_row[c]){
+	    depth_row[c] = z;
+	    face_row[c] = f;
+	  }
+	}
+      }
+    }
+  }
+
+  render_time = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+}
+
+/**
+   Function returns the buffer cell of the image point (u,v) given in shot coordinates or -1 when it is outside the buffer
+*/
+int DepthBuffer::getCell(float u, float v) const{
+
+  // cell c collects the pixels centered in [c*downscale, (c+1)*downscale)
+  int c = int(std::floor((u + 0.5f) / downscale));
+  int r = int(std::floor((v + 0.5f) / downscale));
+
+  if(c < 0 || r < 0 || c >= width || r >= height)
+    return -1;
+
+  return r*width + c;
+}
+
+int DepthBuffer::getFaceAt(float u, float v) const{
+  int cell = getCell(u, v);
+  return (cell == -1) ? -1 : face_idx[cell];
+}
+
+float DepthBuffer::getDepthAt(float u, float v) const{
+  int cell = getCell(u, v);
+  return (cell == -1) ? FLT_MAX : depth[cell];
+}
+
+/**
+   Function returns depth of the point along the optical axis of the camera
+*/
+float DepthBuffer::getDepth(const vcg::Point3f &pt) const{
+  return (pt - origin) * view_axis;
+}
+
+/**
+   Function tests whether the point is seen by the camera, i.e. it projects into the image and no face of the model lies in front of it. Tolerance is relative to the depth, points on the surface itself are visible.
+*/
+bool DepthBuffer::isVisible(const vcg::Point3f &pt, float tolerance) const{
+
+  float pt_depth = getDepth(pt);
+  if(pt_depth <= 0)
+    return false;
+
+  vcg::Point2f p = shot.Project(pt);
+  int cell = getCell(p[0], p[1]);
+  if(cell == -1)
+    return false;
+
+  return pt_depth <= depth[cell]*(1.0f + tolerance);
+}
+
+/**
+   Function returns the point where the ray through image point (u,v) hits the face stored in its cell. The ray is intersected with the plane of the face, so the point is exact also for reduced buffers.
+*/
+bool DepthBuffer::getSurfacePoint(float u, float v, vcg::Point3f &out_pt) const{
+
+  int cell = getCell(u, v);
+  if(cell == -1 || face_idx[cell] == -1)
+    return false;
+
+  const int *tri = &mesh.faces[3*face_idx[cell]];
+  const vcg::Point3f &p0 = mesh.vertices[tri[0]];
+  vcg::Point3f normal = (mesh.vertices[tri[1]] - p0) ^ (mesh.vertices[tri[2]] - p0);
+  vcg::Point3f dir = shot.UnProject(vcg::Point2f(u, v), 1) - origin;
+
+  float denom = dir * normal;
+  if(std::fabs(denom) > 1e-12f)
+    out_pt = origin + dir * (((p0 - origin) * normal) / denom);
+  else
+    out_pt = origin + dir * (depth[cell] / (dir * view_axis));
+
+  return true;
+}
+
+/**
+   Function reads the buffer at every changed pixel of the mask and returns the surface points, or the nearest mesh vertices of the visible faces when snap_to_vertex is set. Points follow the pixel order of the mask.
+*/
+void DepthBuffer::lookupMask(const SpanMask &chng_mask, std::vector<vcg::Point3f> &out_pts, bool snap_to_vertex) const{
+
+  std::vector<cv::Point2f> pts;
+  chng_mask.getPoints(pts);
+
+  const int n_pts = pts.size();
+  std::vector<vcg::Point3f> hit_pts(n_pts);
+  std::vector<char> hit_flags(n_pts, 0);
+
+#pragma omp parallel for schedule(static)
+  for(int i = 0 ; i < n_pts ; i++){
+
+    // mask rows are the first shot coordinate
+    vcg::Point3f surface_pt;
+    if(!getSurfacePoint(pts[i].y, pts[i].x, surface_pt))
+      continue;
+
+    if(snap_to_vertex){
+      const int *tri = &mesh.faces[3*getFaceAt(pts[i].y, pts[i].x)];
+      int nearest = tri[0];
+      for(int k = 1 ; k < 3 ; k++)
+	if((mesh.vertices[tri[k]] - surface_pt).SquaredNorm() < (mesh.vertices[nearest] - surface_pt).SquaredNorm())
+	  nearest = tri[k];
+      surface_pt = mesh.vertices[nearest];
+    }
+
+    hit_pts[i] = surface_pt;
+    hit_flags[i] = 1;
+  }
+
+  out_pts.clear();
+  for(int i = 0 ; i < n_pts ; i++)
+    if(hit_flags[i])
+      out_pts.push_back(hit_pts[i]);
+}
+
+DepthBufferCache::DepthBufferCache(const std::string &filename, int in_downscale) : downscale(in_downscale){
+
+  MyMesh m;
+  getPlyFileVcg(filename, m);
+  mesh = MeshGeometry(m);
+}
+
+/**
+   Function returns depth buffer of the camera, rendering it on the first request
+*/
+DepthBuffer::ConstPtr DepthBufferCache::get(int camera_idx, const vcg::Shot<float> &shot){
+
+  std::map<int, DepthBuffer::ConstPtr>::iterator it = buffers.find(camera_idx);
+  if(it != buffers.end())
+    return it->second;
+
+  DepthBuffer::ConstPtr buffer(new DepthBuffer(mesh, shot, downscale));
+  buffers[camera_idx] = buffer;
+
+  std::cout<<"Depth buffer "<<buffer->getWidth()<<"x"<<buffer->getHeight()<<" of camera "<<camera_idx<<" rendered in "<<buffer->getRenderTime()<<" s"<<std::endl;
+
+  return buffer;
+}
+
+double DepthBufferCache::getRenderTime() const{
+
+  double total = 0;
+  for(std::map<int, DepthBuffer::ConstPtr>::const_iterator it = buffers.begin() ; it != buffers.end() ; ++it)
+    total += it->second->getRenderTime();
+
+  return total;
+}
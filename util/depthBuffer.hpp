@@ -0,0 +1,76 @@
+#ifndef __DEPTHBUFFER_H_INCLUDED__
+#define __DEPTHBUFFER_H_INCLUDED__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "../common/common.hpp"
+#include "meshGeometry.hpp"
+
+class SpanMask;
+
+/**
+   Z-buffer of the old model seen from a single camera. Every cell stores the depth along the optical axis and the index of the nearest face, so projecting a change mask to 3D is a lookup per pixel and visibility of a point is a single depth comparison. Cells are indexed in shot image coordinates, the buffer can be rendered at a reduced resolution given by the downscale factor.
+*/
+class DepthBuffer{
+
+public:
+  typedef boost::shared_ptr<const DepthBuffer> ConstPtr;
+
+  //Rows of the buffer rasterized by one thread
+  static const int BAND_ROWS = 32;
+
+  DepthBuffer(const MeshGeometry &in_mesh, const vcg::Shot<float> &in_shot, int in_downscale = 1);
+
+  int getFaceAt(float u, float v) const;
+  float getDepthAt(float u, float v) const;
+  float getDepth(const vcg::Point3f &pt) const;
+  bool isVisible(const vcg::Point3f &pt, float tolerance = 0.01f) const;
+  bool getSurfacePoint(float u, float v, vcg::Point3f &out_pt) const;
+
+  void lookupMask(const SpanMask &chng_mask, std::vector<vcg::Point3f> &out_pts, bool snap_to_vertex = false) const;
+
+  int getWidth() const {return width;}
+  int getHeight() const {return height;}
+  double getRenderTime() const {return render_time;}
+
+private:
+  void render();
+  int getCell(float u, float v) const;
+
+  const MeshGeometry &mesh;
+  vcg::Shot<float> shot;
+  vcg::Point3f origin;
+  vcg::Point3f view_axis;
+  int downscale;
+  int width;
+  int height;
+  std::vector<float> depth;
+  std::vector<int> face_idx;
+  double render_time;
+};
+
+/**
+   Depth buffers of the cameras of a run, rendered on first use and kept for the following image pairs. The geometry is owned by the cache and must outlive the returned buffers.
+*/
+class DepthBufferCache{
+
+public:
+  DepthBufferCache(const std::string &filename, int in_downscale = 1);
+
+  DepthBuffer::ConstPtr get(int camera_idx, const vcg::Shot<float> &shot);
+  void clear(){buffers.clear();}
+
+  std::size_t size() const {return buffers.size();}
+  double getRenderTime() const;
+
+private:
+  MeshGeometry mesh;
+  int downscale;
+  std::map<int, DepthBuffer::ConstPtr> buffers;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "distanceField.hpp"
+
+#include <cmath>
+#include <iostream>
+
+#include <opencv2/core/core.hpp>
+
+// squared distance of voxels with no occupied voxel in the grid
+static const float DT_INF = 1e20f;
+
+DistanceField::DistanceField(const OccupancyGrid &in_grid) : grid(in_grid), build_time(0){
+  build();
+}
+
+/**
+   Function computes 1D squared distance transform of the sampled function f (Felzenszwalb and Huttenlocher). v and z are work arrays of size n and n+1.
+*/
+void DistanceField::distanceTransform1D(const float *f, int n, float *d, int *v, float *z){
+
+  int k = 0;
+  v[0] = 0;
+  z[0] = -DT_INF;
+  z[1] = DT_INF;
+
+  for(int q = 1 ; q < n ; q++){
+    float s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+    while(s <= z[k]){
+      k--;
+      s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = DT_INF;
+  }
+
+  k = 0;
+  for(int q = 0 ; q < n ; q++){
+    while(z[k+1] < q)
+      k++;
+    d[q] = (q - v[k])*(q - v[k]) + f[v[k]];
+  }
+}
+
+/**
+   Function computes the 3D distance transform as three separable 1D passes along x, y and z
+*/
+void DistanceField::build(){
+
+  int64 t_start = cv::getTickCount();
+
+  const std::vector<int> &layout = grid.getLeafLayout();
+  const Eigen::Vector4i &min_b = grid.getMinBox();
+  const Eigen::Vector4i &max_b = grid.getMaxBox();
+  const Eigen::Vector4i &divb_mul = grid.getDivisionMultiplier();
+
+  int dims[3];
+  for(int d = 0 ; d < 3 ; d++)
+    dims[d] = max_b[d] - min_b[d] + 1;
+
+  dist.resize(layout.size());
+  for(int i = 0 ; i < layout.size() ; i++)
+    dist[i] = (layout[i] == -1) ? DT_INF : 0;
+
+  for(int axis = 0 ; axis < 3 ; axis++){
+
+    // the two axes spanning the lines of this pass
+    int a1 = (axis + 1) % 3;
+    int a2 = (axis + 2) % 3;
+    int n = dims[axis];
+    int n_lines = dims[a1]*dims[a2];
+
+#pragma omp parallel
+    {
+      std::vector<float> f(n), d(n), z(n+1);
+      std::vector<int> v(n);
+
+#pragma omp for schedule(static)
+      for(int line = 0 ; line < n_lines ; line++){
+
+	int base = (line % dims[a1])*divb_mul[a1] + (line / dims[a1])*divb_mul[a2];
+
+	for(int q = 0 ; q < n ; q++)
+	  f[q] = dist[base + q*divb_mul[axis]];
+
+	distanceTransform1D(&f[0], n, &d[0], &v[0], &z[0]);
+
+	for(int q = 0 ; q < n ; q++)
+	  dist[base + q*divb_mul[axis]] = d[q];
+      }
+    }
+  }
+
+  for(int i = 0 ; i < dist.size() ; i++)
+    dist[i] = (dist[i] >= DT_INF) ? DT_INF : std::sqrt(dist[i]);
+
+  build_time = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+  std::cout<<"Distance field of "<<dims[0]<<"x"<<dims[1]<<"x"<<dims[2]<<" voxels built in "<<build_time<<" s"<<std::endl;
+}
+
+/**
+   Function marches the ray from t_min and returns index of the first occupied voxel centroid or -1. Far from the surface the ray jumps by the clearance of the current voxel, near the surface it steps voxel by voxel. If steps is given it receives the number of visited voxels.
+*/
+int DistanceField::trace(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction, const float t_min, int *steps) const{
+
+  // a point of the current voxel is at most half a diagonal from its center, the same holds for the occupied voxel
+  const float half_diagonals = std::sqrt(3.0f);
+  const float leaf = grid.getLeafSize()[0];
+  const float dir_norm = direction.head<3>().norm();
+
+  float t = t_min;
+  int visited = 0;
+  int index = -1;
+
+  GridTraversal ray;
+  grid.initTraversal(origin, direction, t, ray);
+
+  while(grid.isInside(ray.ijk)){
+
+    visited++;
+    index = grid.getCentroidIndexAt(ray.ijk);
+    if(index != -1)
+      break;
+
+    float clearance = (getDistance(ray.ijk) - half_diagonals) * leaf;
+
+    if(clearance > leaf){
+      t += clearance / dir_norm;
+
+      Eigen::Vector4f pt = origin + t * direction;
+      if(!grid.isInside(grid.getGridCoord(pt[0], pt[1], pt[2])))
+	break;
+
+      grid.initTraversal(origin, direction, t, ray);
+      continue;
+    }
+
+    // 3D-DDA step, t becomes the parameter where the ray enters the next voxel
+    int axis;
+    if(ray.t_max[0] <= ray.t_max[1] && ray.t_max[0] <= ray.t_max[2])
+      axis = 0;
+    else if(ray.t_max[1] <= ray.t_max[2] && ray.t_max[1] <= ray.t_max[0])
+      axis = 1;
+    else
+      axis = 2;
+
+    t = ray.t_max[axis];
+    ray.t_max[axis] += ray.t_delta[axis];
+    ray.ijk[axis] += ray.step[axis];
+  }
+
+  if(steps != NULL)
+    *steps = visited;
+
+  return index;
+}
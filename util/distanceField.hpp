@@ -0,0 +1,32 @@
+#ifndef __DISTANCEFIELD_H_INCLUDED__
+#define __DISTANCEFIELD_H_INCLUDED__
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "occupancyGrid.hpp"
+
+/**
+   Euclidean distance transform of the occupied voxels of the occupancy grid. Every voxel stores the distance (in voxels) from its center to the center of the nearest occupied voxel. Rays are marched by the clearance it guarantees (sphere tracing) and fall back to 3D-DDA steps close to the surface, so the first hit is the same voxel the grid traversal finds.
+*/
+class DistanceField{
+
+public:
+  DistanceField(const OccupancyGrid &in_grid);
+
+  float getDistance(const Eigen::Vector3i &ijk) const {return dist[grid.getVoxelIndex(ijk)];}
+  double getBuildTime() const {return build_time;}
+
+  int trace(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction, const float t_min, int *steps = NULL) const;
+
+private:
+  void build();
+  static void distanceTransform1D(const float *f, int n, float *d, int *v, float *z);
+
+  const OccupancyGrid &grid;
+  std::vector<float> dist;
+  double build_time;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "incrementalGrouping.hpp"
+
+#include <algorithm>
+
+//Flags of the queued array, a point may wait in both bucket lists
+static const unsigned char QUEUED_NEW = 1;
+static const unsigned char QUEUED_OLD = 2;
+
+IncrementalGrouping::IncrementalGrouping(const std::vector<PtCamCorr> &pts_corr) : n_new_cams(0), n_old_cams(0){
+
+  const int n_pts = pts_corr.size();
+  int max_obs = 0;
+
+  total_obs.resize(n_pts);
+  for(int i = 0 ; i < n_pts ; i++){
+    total_obs[i] = pts_corr[i].camidx.size();
+    max_obs = std::max(max_obs, total_obs[i]);
+  }
+
+  new_obs.assign(n_pts, 0);
+  old_obs.assign(n_pts, 0);
+  queued.assign(n_pts, 0);
+  changed_pos.assign(n_pts, -1);
+  new_pending.resize(max_obs + 1);
+  old_pending.resize(max_obs + 1);
+}
+
+/**
+   Function registers a new camera with its features
+*/
+void IncrementalGrouping::addNewCamera(int cam_idx, const std::vector<ImgFeature> &feats){
+  addCamera(cam_idx, feats, NEW_GROUP);
+}
+
+/**
+   Function registers an old camera with its features. Old cameras shared by several new ones are counted once.
+*/
+void IncrementalGrouping::addOldCamera(int cam_idx, const std::vector<ImgFeature> &feats){
+  addCamera(cam_idx, feats, OLD_GROUP);
+}
+
+void IncrementalGrouping::addCamera(int cam_idx, const std::vector<ImgFeature> &feats, CameraGroup group){
+
+  if(cam_idx < 0)
+    return;
+
+  if(cam_idx >= cam_group.size())
+    cam_group.resize(cam_idx + 1, NONE);
+
+  if(cam_group[cam_idx] != NONE)
+    return;
+
+  cam_group[cam_idx] = group;
+
+  //Points waiting for the group to grow to their observation count
+  int &n_cams = (group == NEW_GROUP) ? n_new_cams : n_old_cams;
+  std::vector<std::vector<int> > &pending = (group == NEW_GROUP) ? new_pending : old_pending;
+  const unsigned char flag = (group == NEW_GROUP) ? QUEUED_NEW : QUEUED_OLD;
+
+  n_cams++;
+
+  if(n_cams < pending.size()){
+    std::vector<int> bucket;
+    bucket.swap(pending[n_cams]);
+    for(int k = 0 ; k < bucket.size() ; k++){
+      queued[bucket[k]] &= ~flag;
+      update(bucket[k]);
+    }
+  }
+
+  for(int k = 0 ; k < feats.size() ; k++){
+    int pt = feats[k].idx;
+    if(pt < 0 || pt >= total_obs.size())
+      continue;
+    if(group == NEW_GROUP)
+      new_obs[pt]++;
+    else
+      old_obs[pt]++;
+    update(pt);
+  }
+}
+
+/**
+   Function reevaluates the point and moves it in or out of the changed set
+*/
+void IncrementalGrouping::update(int pt){
+
+  const bool only_new = new_obs[pt] > 0 && old_obs[pt] == 0;
+  const bool only_old = old_obs[pt] > 0 && new_obs[pt] == 0;
+  const bool is_changed = (only_new && total_obs[pt] <= n_new_cams) || (only_old && total_obs[pt] <= n_old_cams);
+
+  if(only_new && total_obs[pt] > n_new_cams && !(queued[pt] & QUEUED_NEW)){
+    new_pending[total_obs[pt]].push_back(pt);
+    queued[pt] |= QUEUED_NEW;
+  }
+  if(only_old && total_obs[pt] > n_old_cams && !(queued[pt] & QUEUED_OLD)){
+    old_pending[total_obs[pt]].push_back(pt);
+    queued[pt] |= QUEUED_OLD;
+  }
+
+  if(is_changed && changed_pos[pt] == -1){
+    changed_pos[pt] = changed.size();
+    changed.push_back(pt);
+  }
+  else if(!is_changed && changed_pos[pt] != -1){
+    //Last point takes the place of the removed one
+    int last = changed.back();
+    changed[changed_pos[pt]] = last;
+    changed_pos[last] = changed_pos[pt];
+    changed.pop_back();
+    changed_pos[pt] = -1;
+  }
+}
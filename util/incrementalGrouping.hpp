@@ -0,0 +1,51 @@
+#ifndef __INCREMENTALGROUPING_H_INCLUDED__
+#define __INCREMENTALGROUPING_H_INCLUDED__
+
+#include <vector>
+
+#include "../common/common.hpp"
+
+/**
+   Point grouping updated camera by camera. Every point keeps the number of its observations in the registered new cameras and in the registered old cameras. A point is changed when it is observed only by one of the two groups and by no more cameras in total than the group has, which is the test of ImgChangeDetector::imgFeatDiff. Adding a camera costs O(observations of the camera): points waiting only for their group to grow are parked in buckets by their total observation count and rechecked when the group reaches that size.
+*/
+class IncrementalGrouping{
+
+public:
+  IncrementalGrouping(const std::vector<PtCamCorr> &pts_corr);
+
+  void addNewCamera(int cam_idx, const std::vector<ImgFeature> &feats);
+  void addOldCamera(int cam_idx, const std::vector<ImgFeature> &feats);
+
+  int getNewCameraCount() const {return n_new_cams;}
+  int getOldCameraCount() const {return n_old_cams;}
+  std::size_t size() const {return changed.size();}
+  bool isChanged(int pt) const {return changed_pos[pt] != -1;}
+  //Changed points in arbitrary order, valid until the next camera is added
+  const std::vector<int>& getChanged() const {return changed;}
+
+private:
+  enum CameraGroup{NONE, NEW_GROUP, OLD_GROUP};
+
+  void addCamera(int cam_idx, const std::vector<ImgFeature> &feats, CameraGroup group);
+  void update(int pt);
+
+  //Number of cameras observing every point
+  std::vector<int> total_obs;
+  //Observations of every point in the registered new and old cameras
+  std::vector<int> new_obs;
+  std::vector<int> old_obs;
+  std::vector<unsigned char> cam_group;
+  int n_new_cams;
+  int n_old_cams;
+
+  //Points observed only by one group with more observations than cameras in the group, bucketed by their total observation count
+  std::vector<std::vector<int> > new_pending;
+  std::vector<std::vector<int> > old_pending;
+  std::vector<unsigned char> queued;
+
+  //Changed points in arbitrary order and position of every point in it, -1 if not changed
+  std::vector<int> changed;
+  std::vector<int> changed_pos;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef __LEAFKEYINDEX_H_INCLUDED__
+#define __LEAFKEYINDEX_H_INCLUDED__
+
+#include <vector>
+#include <cstddef>
+
+/**
+   Hash table from integer voxel keys (x,y,z) to leaf indices. Keys are packed into one 64-bit word, 21 bits per axis, and kept in a flat open addressing table with linear probing, so a lookup costs a multiply and usually a single cache line instead of formatting and comparing strings in a std::map.
+*/
+class LeafKeyIndex{
+
+public:
+  typedef unsigned long long Key;
+  static const int AXIS_BITS = 21;
+
+  explicit LeafKeyIndex(std::size_t n_keys = 0){
+    reserve(n_keys);
+  }
+
+  /**
+     Function prepares the table for n_keys keys, load factor is kept at most 1/2. Existing entries are dropped.
+  */
+  void reserve(std::size_t n_keys){
+    std::size_t capacity = 16;
+    while(capacity < 2*n_keys)
+      capacity <<= 1;
+
+    mask = capacity - 1;
+    keys.assign(capacity, Key(EMPTY));
+    values.assign(capacity, -1);
+    n_entries = 0;
+  }
+
+  static Key pack(unsigned int x, unsigned int y, unsigned int z){
+    const Key axis = (Key(1) << AXIS_BITS) - 1;
+    return ((Key(x) & axis) << (2*AXIS_BITS)) | ((Key(y) & axis) << AXIS_BITS) | (Key(z) & axis);
+  }
+
+  /**
+     Function interleaves bits of the axes into a morton code, sorting keys by it keeps close voxels close in memory
+  */
+  static Key morton(unsigned int x, unsigned int y, unsigned int z){
+    return spreadBits(x) << 2 | spreadBits(y) << 1 | spreadBits(z);
+  }
+
+  /**
+     Function stores the value of the key, an existing value is overwritten
+  */
+  void insert(unsigned int x, unsigned int y, unsigned int z, int value){
+
+    if(2*(n_entries + 1) > keys.size())
+      grow();
+
+    const Key key = pack(x, y, z);
+    std::size_t slot = hash(key);
+
+    while(keys[slot] != EMPTY && keys[slot] != key)
+      slot = (slot + 1) & mask;
+
+    if(keys[slot] == EMPTY)
+      n_entries++;
+
+    keys[slot] = key;
+    values[slot] = value;
+  }
+
+  /**
+     Function returns the value of the key or -1 if the key is not stored
+  */
+  int find(unsigned int x, unsigned int y, unsigned int z) const{
+
+    const Key key = pack(x, y, z);
+    std::size_t slot = hash(key);
+
+    while(keys[slot] != EMPTY){
+      if(keys[slot] == key)
+	return values[slot];
+      slot = (slot + 1) & mask;
+    }
+    return -1;
+  }
+
+  std::size_t size() const {return n_entries;}
+
+private:
+  //Packed keys use 63 bits, so all ones never occurs
+  static const Key EMPTY = ~Key(0);
+
+  //Moves bit i of the lowest AXIS_BITS bits to bit 3*i
+  static Key spreadBits(unsigned int v){
+    Key b = v & ((Key(1) << AXIS_BITS) - 1);
+    b = (b | b << 32) & 0x1f00000000ffffULL;
+    b = (b | b << 16) & 0x1f0000ff0000ffULL;
+    b = (b | b << 8) & 0x100f00f00f00f00fULL;
+    b = (b | b << 4) & 0x10c30c30c30c30c3ULL;
+    b = (b | b << 2) & 0x1249249249249249ULL;
+    return b;
+  }
+
+  std::size_t hash(Key key) const{
+    //Fibonacci hashing, high bits of the product are mixed best
+    return std::size_t((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+  }
+
+  void grow(){
+    std::vector<Key> old_keys;
+    std::vector<int> old_values;
+    old_keys.swap(keys);
+    old_values.swap(values);
+
+    const std::size_t capacity = 2*old_keys.size();
+    mask = capacity - 1;
+    keys.assign(capacity, Key(EMPTY));
+    values.assign(capacity, -1);
+
+    for(std::size_t i = 0 ; i < old_keys.size() ; i++){
+      if(old_keys[i] == EMPTY)
+	continue;
+      std::size_t slot = hash(old_keys[i]);
+      while(keys[slot] != EMPTY)
+	slot = (slot + 1) & mask;
+      keys[slot] = old_keys[i];
+      values[slot] = old_values[i];
+    }
+  }
+
+  std::vector<Key> keys;
+  std::vector<int> values;
+  std::size_t mask;
+  std::size_t n_entries;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "maskComponents.hpp"
+#include "spanMask.hpp"
+
+#include <algorithm>
+
+MaskComponents::MaskComponents(const SpanMask &in_mask) : mask(in_mask), n_components(0){
+
+  const std::vector<MaskSpan> &spans = mask.getSpans();
+  const int n_spans = spans.size();
+
+  std::vector<int> parent(n_spans);
+  for(int s = 0 ; s < n_spans ; s++)
+    parent[s] = s;
+
+  //First pass, spans of the previous row touching the span (diagonals included) are merged with it
+  int prev_first = 0, prev_last = 0;
+
+  for(int s = 0 ; s < n_spans ; ){
+
+    const int row = spans[s].row;
+    int row_last = s;
+    while(row_last < n_spans && spans[row_last].row == row)
+      row_last++;
+
+    if(prev_last > prev_first && spans[prev_first].row != row - 1)
+      prev_first = prev_last;
+
+    int p = prev_first;
+    for(int k = s ; k < row_last ; k++){
+
+      //Spans of both rows are sorted by column, so the scan of the previous row only moves forward
+      while(p < prev_last && spans[p].last < spans[k].first)
+	p++;
+
+      for(int q = p ; q < prev_last && spans[q].first <= spans[k].last ; q++){
+	int a = findRoot(parent, k), b = findRoot(parent, q);
+	if(a != b)
+	  parent[std::max(a, b)] = std::min(a, b);
+      }
+    }
+
+    prev_first = s;
+    prev_last = row_last;
+    s = row_last;
+  }
+
+  //Second pass, roots always precede the spans of their tree
+  span_labels.resize(n_spans);
+  for(int s = 0 ; s < n_spans ; s++)
+    span_labels[s] = (parent[s] == s) ? n_components++ : span_labels[findRoot(parent, s)];
+}
+
+int MaskComponents::findRoot(std::vector<int> &parent, int i){
+
+  while(parent[i] != i){
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+/**
+   Function returns the component of pixel (x,y), -1 if the pixel is not in the mask. The span of the pixel is binary searched in its row, no per-pixel image is kept.
+*/
+int MaskComponents::getLabel(int x, int y) const{
+
+  const int s = mask.findSpan(x, y);
+  return s < 0 ? -1 : span_labels[s];
+}
+
+/**
+   Function returns pixels representing the components: all their boundary pixels and interior pixels on a grid of the given stride. Label of the component is written for every pixel.
+*/
+void MaskComponents::getSamples(int stride, std::vector<cv::Point2f> &out_pts, std::vector<int> &out_labels) const{
+
+  const std::vector<MaskSpan> &spans = mask.getSpans();
+
+  for(int s = 0 ; s < spans.size() ; s++){
+
+    const MaskSpan &span = spans[s];
+    const bool row_sampled = (span.row % stride) == 0;
+
+    for(int c = span.first ; c < span.last ; c++){
+
+      bool boundary = c == span.first || c == span.last - 1 || getLabel(c, span.row - 1) < 0 || getLabel(c, span.row + 1) < 0;
+
+      if(boundary || (row_sampled && (c % stride) == 0)){
+	out_pts.push_back(cv::Point2f(c, span.row));
+	out_labels.push_back(span_labels[s]);
+      }
+    }
+  }
+}
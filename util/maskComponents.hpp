@@ -0,0 +1,33 @@
+#ifndef __MASKCOMPONENTS_H_INCLUDED__
+#define __MASKCOMPONENTS_H_INCLUDED__
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+class SpanMask;
+
+/**
+   8-connected components of a change mask. Spans of the mask are labelled with two passes of union-find: the first pass merges overlapping spans of neighbouring rows, the second one flattens the trees into consecutive labels. Work depends on the number of spans, not on the number of pixels.
+*/
+class MaskComponents{
+
+public:
+  MaskComponents(const SpanMask &in_mask);
+
+  int size() const {return n_components;}
+  const std::vector<int>& getSpanLabels() const {return span_labels;}
+  int getLabel(int x, int y) const;
+
+  void getSamples(int stride, std::vector<cv::Point2f> &out_pts, std::vector<int> &out_labels) const;
+
+private:
+  static int findRoot(std::vector<int> &parent, int i);
+
+  const SpanMask &mask;
+  //Component of every span of the mask
+  std::vector<int> span_labels;
+  int n_components;
+};
+
+#endif
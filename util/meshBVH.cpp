@@ -0,0 +1,437 @@
+#include "meshBVH.hpp"
+#include "spanMask.hpp"
+#include "utilIO.hpp"
+#include "rayGenerator.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+#include <opencv2/core/core.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// maximal depth of the hierarchy, bounds the traversal stack
+static const int MAX_DEPTH = 128;
+
+MeshBVH::MeshBVH(const std::string &filename) : build_time(0){
+
+  MyMesh m;
+  getPlyFileVcg(filename, m);
+  mesh = MeshGeometry(m);
+  build();
+}
+
+MeshBVH::MeshBVH(const MyMesh &m) : mesh(m), build_time(0){
+  build();
+}
+
+MeshBVH::MeshBVH(const MeshGeometry &in_mesh) : mesh(in_mesh), build_time(0){
+  build();
+}
+
+/**
+   Predicate selecting triangles whose centroid falls into the bins left of the split plane
+*/
+struct BinPredicate{
+  const std::vector<Eigen::Vector3f> &centroids;
+  int axis;
+  float cmin;
+  float scale;
+  int split_bin;
+
+  BinPredicate(const std::vector<Eigen::Vector3f> &in_centroids, int in_axis, float in_cmin, float in_scale, int in_split_bin) : centroids(in_centroids), axis(in_axis), cmin(in_cmin), scale(in_scale), split_bin(in_split_bin){}
+
+  bool operator()(int tri) const{
+    return std::min(MeshBVH::SAH_BINS - 1, int((centroids[tri][axis] - cmin)*scale)) <= split_bin;
+  }
+};
+
+static float boxArea(const Eigen::Vector3f &bmin, const Eigen::Vector3f &bmax){
+  Eigen::Vector3f ext = (bmax - bmin).cwiseMax(Eigen::Vector3f::Zero());
+  return 2.0f*(ext[0]*ext[1] + ext[1]*ext[2] + ext[2]*ext[0]);
+}
+
+/**
+   Function builds the hierarchy over the faces of the mesh geometry
+*/
+void MeshBVH::build(){
+
+  int64 t_start = cv::getTickCount();
+
+  const int n_tris = mesh.getFaceCount();
+  std::vector<Eigen::Vector3f> centroids(n_tris), tri_min(n_tris), tri_max(n_tris);
+  std::vector<int> tri_idx(n_tris);
+
+  for(int i = 0 ; i < n_tris ; i++){
+    tri_min[i] = Eigen::Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    tri_max[i] = Eigen::Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(int k = 0 ; k < 3 ; k++){
+      const vcg::Point3f &p = mesh.vertices[mesh.faces[3*i+k]];
+      Eigen::Vector3f v(p[0], p[1], p[2]);
+      tri_min[i] = tri_min[i].cwiseMin(v);
+      tri_max[i] = tri_max[i].cwiseMax(v);
+    }
+    centroids[i] = 0.5f*(tri_min[i] + tri_max[i]);
+    tri_idx[i] = i;
+  }
+
+  nodes.clear();
+  packs.clear();
+  nodes.reserve(2*n_tris/LEAF_SIZE + 1);
+  nodes.push_back(BVHNode());
+
+  if(n_tris > 0)
+    buildNode(0, 0, n_tris, 0, tri_idx, centroids, tri_min, tri_max);
+  else{
+    for(int d = 0 ; d < 3 ; d++){
+      nodes[0].bmin[d] = FLT_MAX;
+      nodes[0].bmax[d] = -FLT_MAX;
+    }
+    nodes[0].left_first = 0;
+    nodes[0].count = 0;
+  }
+
+  build_time = double(cv::getTickCount() - t_start)/cv::getTickFrequency();
+
+  std::cout<<"Mesh BVH of "<<n_tris<<" faces: "<<nodes.size()<<" nodes, built in "<<build_time<<" s"<<std::endl;
+}
+
+/**
+   Function fills node node_idx with triangles tri_idx[first, first+count) and splits it recursively. The split plane is chosen by the surface area heuristic evaluated on SAH_BINS bins along every axis.
+*/
+void MeshBVH::buildNode(int node_idx, int first, int count, int depth, std::vector<int> &tri_idx, const std::vector<Eigen::Vector3f> &centroids, const std::vector<Eigen::Vector3f> &tri_min, const std::vector<Eigen::Vector3f> &tri_max){
+
+  Eigen::Vector3f bmin(FLT_MAX, FLT_MAX, FLT_MAX), bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  Eigen::Vector3f cmin = bmin, cmax = bmax;
+
+  for(int i = first ; i < first + count ; i++){
+    int tri = tri_idx[i];
+    bmin = bmin.cwiseMin(tri_min[tri]);
+    bmax = bmax.cwiseMax(tri_max[tri]);
+    cmin = cmin.cwiseMin(centroids[tri]);
+    cmax = cmax.cwiseMax(centroids[tri]);
+  }
+
+  for(int d = 0 ; d < 3 ; d++){
+    nodes[node_idx].bmin[d] = bmin[d];
+    nodes[node_idx].bmax[d] = bmax[d];
+  }
+
+  // best split found by the binned SAH
+  int best_axis = -1, best_bin = -1;
+  float best_cost = count*boxArea(bmin, bmax);
+
+  if(count > LEAF_SIZE && depth < MAX_DEPTH - 1){
+
+    for(int axis = 0 ; axis < 3 ; axis++){
+
+      float extent = cmax[axis] - cmin[axis];
+      if(extent <= 0)
+	continue;
+
+      int bin_count[SAH_BINS];
+      Eigen::Vector3f bin_min[SAH_BINS], bin_max[SAH_BINS];
+
+      for(int b = 0 ; b < SAH_BINS ; b++){
+	bin_count[b] = 0;
+	bin_min[b] = Eigen::Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
+	bin_max[b] = Eigen::Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      }
+
+      float scale = SAH_BINS / extent;
+      for(int i = first ; i < first + count ; i++){
+	int tri = tri_idx[i];
+	int b = std::min(SAH_BINS - 1, int((centroids[tri][axis] - cmin[axis])*scale));
+	bin_count[b]++;
+	bin_min[b] = bin_min[b].cwiseMin(tri_min[tri]);
+	bin_max[b] = bin_max[b].cwiseMax(tri_max[tri]);
+      }
+
+      // sweep from the right to get area and count right of every plane
+      float right_area[SAH_BINS];
+      int right_count[SAH_BINS];
+      Eigen::Vector3f acc_min(FLT_MAX, FLT_MAX, FLT_MAX), acc_max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      int acc_count = 0;
+
+      for(int b = SAH_BINS - 1 ; b > 0 ; b--){
+	acc_min = acc_min.cwiseMin(bin_min[b]);
+	acc_max = acc_max.cwiseMax(bin_max[b]);
+	acc_count += bin_count[b];
+	right_area[b] = boxArea(acc_min, acc_max);
+	right_count[b] = acc_count;
+      }
+
+      acc_min = Eigen::Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
+      acc_max = Eigen::Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      acc_count = 0;
+
+      for(int b = 0 ; b < SAH_BINS - 1 ; b++){
+	acc_min = acc_min.cwiseMin(bin_min[b]);
+	acc_max = acc_max.cwiseMax(bin_max[b]);
+	acc_count += bin_count[b];
+
+	if(acc_count == 0 || right_count[b+1] == 0)
+	  continue;
+
+	float cost = acc_count*boxArea(acc_min, acc_max) + right_count[b+1]*right_area[b+1];
+	if(cost < best_cost){
+	  best_cost = cost;
+	  best_axis = axis;
+	  best_bin = b;
+	}
+      }
+    }
+  }
+
+  // leaf: the split does not pay off or the triangles cannot be separated
+  if(best_axis == -1){
+    nodes[node_idx].left_first = packs.size();
+    nodes[node_idx].count = (count + LEAF_SIZE - 1)/LEAF_SIZE;
+
+    for(int p = 0 ; p < nodes[node_idx].count ; p++){
+      TriPack pack;
+      for(int s = 0 ; s < LEAF_SIZE ; s++){
+	int i = first + p*LEAF_SIZE + s;
+	pack.face[s] = -1;
+	for(int d = 0 ; d < 3 ; d++)
+	  pack.v0[d][s] = pack.e1[d][s] = pack.e2[d][s] = 0;
+
+	if(i >= first + count)
+	  continue;
+
+	int tri = tri_idx[i];
+	const vcg::Point3f &a = mesh.vertices[mesh.faces[3*tri]];
+	const vcg::Point3f &b = mesh.vertices[mesh.faces[3*tri+1]];
+	const vcg::Point3f &c = mesh.vertices[mesh.faces[3*tri+2]];
+	pack.face[s] = tri;
+	for(int d = 0 ; d < 3 ; d++){
+	  pack.v0[d][s] = a[d];
+	  pack.e1[d][s] = b[d] - a[d];
+	  pack.e2[d][s] = c[d] - a[d];
+	}
+      }
+      packs.push_back(pack);
+    }
+    return;
+  }
+
+  float scale = SAH_BINS / (cmax[best_axis] - cmin[best_axis]);
+  int *mid = std::partition(&tri_idx[0] + first, &tri_idx[0] + first + count, BinPredicate(centroids, best_axis, cmin[best_axis], scale, best_bin));
+  int left_count = mid - (&tri_idx[0] + first);
+
+  int left = nodes.size();
+  nodes.push_back(BVHNode());
+  nodes.push_back(BVHNode());
+  nodes[node_idx].left_first = left;
+  nodes[node_idx].count = 0;
+
+  buildNode(left, first, left_count, depth + 1, tri_idx, centroids, tri_min, tri_max);
+  buildNode(left + 1, first + left_count, count - left_count, depth + 1, tri_idx, centroids, tri_min, tri_max);
+}
+
+/**
+   Function intersects the ray with the four triangles of the pack, the nearest hit closer than t_hit is kept
+*/
+void MeshBVH::intersectPack(const TriPack &pack, const Eigen::Vector3f &origin, const Eigen::Vector3f &direction, float &t_hit, int &face_hit) const{
+
+  const float det_eps = 1e-12f;
+  const float t_eps = 1e-6f;
+
+#ifdef __SSE2__
+
+  __m128 e1[3], e2[3], tvec[3], dir[3];
+  for(int d = 0 ; d < 3 ; d++){
+    e1[d] = _mm_loadu_ps(pack.e1[d]);
+    e2[d] = _mm_loadu_ps(pack.e2[d]);
+    tvec[d] = _mm_sub_ps(_mm_set1_ps(origin[d]), _mm_loadu_ps(pack.v0[d]));
+    dir[d] = _mm_set1_ps(direction[d]);
+  }
+
+  // pvec = dir x e2
+  __m128 px = _mm_sub_ps(_mm_mul_ps(dir[1], e2[2]), _mm_mul_ps(dir[2], e2[1]));
+  __m128 py = _mm_sub_ps(_mm_mul_ps(dir[2], e2[0]), _mm_mul_ps(dir[0], e2[2]));
+  __m128 pz = _mm_sub_ps(_mm_mul_ps(dir[0], e2[1]), _mm_mul_ps(dir[1], e2[0]));
+
+  __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], px), _mm_mul_ps(e1[1], py)), _mm_mul_ps(e1[2], pz));
+  __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+  __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tvec[0], px), _mm_mul_ps(tvec[1], py)), _mm_mul_ps(tvec[2], pz)), inv_det);
+
+  // qvec = tvec x e1
+  __m128 qx = _mm_sub_ps(_mm_mul_ps(tvec[1], e1[2]), _mm_mul_ps(tvec[2], e1[1]));
+  __m128 qy = _mm_sub_ps(_mm_mul_ps(tvec[2], e1[0]), _mm_mul_ps(tvec[0], e1[2]));
+  __m128 qz = _mm_sub_ps(_mm_mul_ps(tvec[0], e1[1]), _mm_mul_ps(tvec[1], e1[0]));
+
+  __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], qx), _mm_mul_ps(dir[1], qy)), _mm_mul_ps(dir[2], qz)), inv_det);
+  __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qx), _mm_mul_ps(e2[1], qy)), _mm_mul_ps(e2[2], qz)), inv_det);
+
+  __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+  __m128 zero = _mm_setzero_ps();
+  __m128 mask = _mm_cmpgt_ps(abs_det, _mm_set1_ps(det_eps));
+  mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+  mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+  mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+  mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(t_eps)));
+  mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(t_hit)));
+
+  int bits = _mm_movemask_ps(mask);
+  if(bits == 0)
+    return;
+
+  float t_lanes[4];
+  _mm_storeu_ps(t_lanes, t);
+
+  for(int s = 0 ; s < 4 ; s++)
+    if(((bits >> s) & 1) && t_lanes[s] < t_hit){
+      t_hit = t_lanes[s];
+      face_hit = pack.face[s];
+    }
+
+#else
+
+  for(int s = 0 ; s < LEAF_SIZE ; s++){
+
+    if(pack.face[s] == -1)
+      continue;
+
+    Eigen::Vector3f e1(pack.e1[0][s], pack.e1[1][s], pack.e1[2][s]);
+    Eigen::Vector3f e2(pack.e2[0][s], pack.e2[1][s], pack.e2[2][s]);
+    Eigen::Vector3f tvec = origin - Eigen::Vector3f(pack.v0[0][s], pack.v0[1][s], pack.v0[2][s]);
+
+    Eigen::Vector3f pvec = direction.cross(e2);
+    float det = e1.dot(pvec);
+    if(std::fabs(det) <= det_eps)
+      continue;
+
+    float inv_det = 1.0f/det;
+    float u = tvec.dot(pvec)*inv_det;
+    if(u < 0)
+      continue;
+
+    Eigen::Vector3f qvec = tvec.cross(e1);
+    float v = direction.dot(qvec)*inv_det;
+    if(v < 0 || u + v > 1.0f)
+      continue;
+
+    float t = e2.dot(qvec)*inv_det;
+    if(t > t_eps && t < t_hit){
+      t_hit = t;
+      face_hit = pack.face[s];
+    }
+  }
+
+#endif
+}
+
+/**
+   Function finds the nearest intersection of the ray with the mesh. Returns false if the ray misses the mesh.
+*/
+bool MeshBVH::intersect(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction, float &t_hit, int &face_hit) const{
+
+  t_hit = FLT_MAX;
+  face_hit = -1;
+
+  if(packs.empty())
+    return false;
+
+  Eigen::Vector3f inv_dir(1.0f/direction[0], 1.0f/direction[1], 1.0f/direction[2]);
+
+  int stack[MAX_DEPTH + 1];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while(stack_size > 0){
+
+    const BVHNode &node = nodes[stack[--stack_size]];
+
+    if(node.isLeaf()){
+      for(int p = node.left_first ; p < node.left_first + node.count ; p++)
+	intersectPack(packs[p], origin, direction, t_hit, face_hit);
+      continue;
+    }
+
+    // entry distances of both children, missed children get FLT_MAX
+    float t_child[2];
+    for(int c = 0 ; c < 2 ; c++){
+      const BVHNode &child = nodes[node.left_first + c];
+      float t_near = 0, t_far = t_hit;
+      for(int d = 0 ; d < 3 ; d++){
+	float t0 = (child.bmin[d] - origin[d])*inv_dir[d];
+	float t1 = (child.bmax[d] - origin[d])*inv_dir[d];
+	t_near = std::max(t_near, std::min(t0, t1));
+	t_far = std::min(t_far, std::max(t0, t1));
+      }
+      // conservative slab test, rays grazing a box face must not miss it through rounding
+      t_child[c] = (t_near <= t_far*1.0000004f) ? t_near : FLT_MAX;
+    }
+
+    // push the farther child first so the nearer one is traversed first
+    int near_child = (t_child[0] <= t_child[1]) ? 0 : 1;
+    int far_child = 1 - near_child;
+
+    if(t_child[far_child] != FLT_MAX)
+      stack[stack_size++] = node.left_first + far_child;
+    if(t_child[near_child] != FLT_MAX)
+      stack[stack_size++] = node.left_first + near_child;
+  }
+
+  return face_hit != -1;
+}
+
+/**
+   Function returns the vertex of the face closest to the point
+*/
+vcg::Point3f MeshBVH::getNearestVertex(int face, const vcg::Point3f &pt) const{
+
+  int best = mesh.faces[3*face];
+  for(int k = 1 ; k < 3 ; k++)
+    if((mesh.vertices[mesh.faces[3*face+k]] - pt).SquaredNorm() < (mesh.vertices[best] - pt).SquaredNorm())
+      best = mesh.faces[3*face+k];
+
+  return mesh.vertices[best];
+}
+
+/**
+   Function shoots a ray through every changed pixel of the mask and returns the surface hits, or the nearest mesh vertices of the hit faces when snap_to_vertex is set. Points follow the pixel order of the mask.
+*/
+void MeshBVH::castMask(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<vcg::Point3f> &out_pts, bool snap_to_vertex) const{
+
+  std::vector<cv::Point2f> pts;
+  chng_mask.getPoints(pts);
+
+  const int n_pts = pts.size();
+  std::vector<vcg::Point3f> hit_pts(n_pts);
+  std::vector<char> hit_flags(n_pts, 0);
+
+  const vcg::Point3f vcg_origin = shot.Extrinsics.Tra();
+  const Eigen::Vector3f origin(vcg_origin[0], vcg_origin[1], vcg_origin[2]);
+  const CameraRayGenerator ray_gen(shot);
+
+#pragma omp parallel for schedule(dynamic, 64)
+  for(int i = 0 ; i < n_pts ; i++){
+
+    float ray_dir[3];
+    ray_gen.getDirection(pts[i].x, pts[i].y, ray_dir);
+    vcg::Point3f dir(ray_dir[0], ray_dir[1], ray_dir[2]);
+    Eigen::Vector3f direction(dir[0], dir[1], dir[2]);
+
+    float t_hit;
+    int face_hit;
+
+    if(!intersect(origin, direction, t_hit, face_hit))
+      continue;
+
+    vcg::Point3f surface_pt = vcg_origin + dir*t_hit;
+    hit_pts[i] = snap_to_vertex ? getNearestVertex(face_hit, surface_pt) : surface_pt;
+    hit_flags[i] = 1;
+  }
+
+  out_pts.clear();
+  for(int i = 0 ; i < n_pts ; i++)
+    if(hit_flags[i])
+      out_pts.push_back(hit_pts[i]);
+}
@@ -0,0 +1,70 @@
+#ifndef __MESHBVH_H_INCLUDED__
+#define __MESHBVH_H_INCLUDED__
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <Eigen/Core>
+
+#include "../common/common.hpp"
+#include "meshGeometry.hpp"
+
+class SpanMask;
+
+/**
+   Node of the bounding volume hierarchy. Inner nodes store index of the left child (the right one follows it), leaves store the first triangle pack and the number of packs.
+*/
+struct BVHNode{
+  float bmin[3];
+  float bmax[3];
+  int left_first;
+  int count;
+
+  bool isLeaf() const {return count > 0;}
+};
+
+/**
+   Four triangles of a leaf in structure of arrays layout for the 4-wide Moller-Trumbore test. Unused slots hold degenerate triangles.
+*/
+struct TriPack{
+  float v0[3][4];
+  float e1[3][4];
+  float e2[3][4];
+  int face[4];
+};
+
+/**
+   Bounding volume hierarchy over the faces of the old model mesh, built with binned SAH. The structure is immutable after construction so it is shared by all image pairs of a run and queried from several threads.
+*/
+class MeshBVH{
+
+public:
+  typedef boost::shared_ptr<const MeshBVH> ConstPtr;
+
+  static const int LEAF_SIZE = 4;
+  static const int SAH_BINS = 16;
+
+  MeshBVH(const std::string &filename);
+  MeshBVH(const MyMesh &m);
+  MeshBVH(const MeshGeometry &in_mesh);
+
+  bool intersect(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction, float &t_hit, int &face_hit) const;
+  void castMask(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<vcg::Point3f> &out_pts, bool snap_to_vertex = false) const;
+  vcg::Point3f getNearestVertex(int face, const vcg::Point3f &pt) const;
+
+  std::size_t getFaceCount() const {return mesh.getFaceCount();}
+  double getBuildTime() const {return build_time;}
+
+private:
+  void build();
+  void buildNode(int node_idx, int first, int count, int depth, std::vector<int> &tri_idx, const std::vector<Eigen::Vector3f> &centroids, const std::vector<Eigen::Vector3f> &tri_min, const std::vector<Eigen::Vector3f> &tri_max);
+  void intersectPack(const TriPack &pack, const Eigen::Vector3f &origin, const Eigen::Vector3f &direction, float &t_hit, int &face_hit) const;
+
+  MeshGeometry mesh;
+  std::vector<BVHNode> nodes;
+  std::vector<TriPack> packs;
+  double build_time;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#include "meshGeometry.hpp"
+
+MeshGeometry::MeshGeometry(const MyMesh &m){
+
+  vertices.resize(m.vert.size());
+  for(int i = 0 ; i < m.vert.size() ; i++)
+    vertices[i] = m.vert[i].cP();
+
+  for(int i = 0 ; i < m.face.size() ; i++){
+    const MyFace &f = m.face[i];
+    if(f.IsD())
+      continue;
+    for(int k = 0 ; k < 3 ; k++)
+      faces.push_back(vcg::tri::Index(m, f.cV(k)));
+  }
+}
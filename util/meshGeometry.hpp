@@ -0,0 +1,22 @@
+#ifndef __MESHGEOMETRY_H_INCLUDED__
+#define __MESHGEOMETRY_H_INCLUDED__
+
+#include <vector>
+
+#include "../common/common.hpp"
+
+/**
+   Triangles of the old model in a flat layout, not deleted faces only. Shared by the mesh BVH and the depth buffers rendered from the model.
+*/
+struct MeshGeometry{
+  std::vector<vcg::Point3f> vertices;
+  //Three vertex indices per face
+  std::vector<int> faces;
+
+  MeshGeometry(){}
+  MeshGeometry(const MyMesh &m);
+
+  std::size_t getFaceCount() const {return faces.size()/3;}
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include <pcl/kdtree/kdtree_flann.h>
 
 #include <ctime>
+#include <cfloat>
+#include <algorithm>
 
 typedef vcg::tri::UpdateTopology<MyMesh>::PEdge SingleEdge;
 
@@ -106,19 +108,15 @@ Function converts OpenCV matrix of 3D points into vector of VCG points
 */
 void DataProcessing::cvt3Dmat2vcg(const cv::Mat &inMat, std::vector<vcg::Point3f> &out_pts){
 
-  cv::Mat tmpMat;
-  float w, x, y, z;
+  const float *x = inMat.ptr<float>(0);
+  const float *y = inMat.ptr<float>(1);
+  const float *z = inMat.ptr<float>(2);
+  const float *w = inMat.ptr<float>(3);
 
-  for(int c = 0 ; c < inMat.cols; c++){      
-    tmpMat  = inMat.col(c);
+  out_pts.reserve(out_pts.size() + inMat.cols);
 
-    w = tmpMat.at<float>(3,0);
-    x = tmpMat.at<float>(0,0)/w;
-    y = tmpMat.at<float>(1,0)/w;
-    z = tmpMat.at<float>(2,0)/w;
-      
-    out_pts.push_back(vcg::Point3f(x,y,z));
-  }
+  for(int c = 0 ; c < inMat.cols; c++)
+    out_pts.push_back(vcg::Point3f(x[c]/w[c], y[c]/w[c], z[c]/w[c]));
 }
 /**
 Function performs simple change detection operation for two images based on image difference and thresholding using Otsu algorithm
@@ -217,6 +215,195 @@ bool ImgProcessing::getImgFundMat(cv::Mat img1, cv::Mat img2, cv::Mat &H){
 }
 
 
+/**
+   Function computes the part of the source image which is mapped by homography H inside the destination image. The polygon is clipped to the source image and shrunk by the margin so that interpolated border pixels are excluded. Returns false if the images do not overlap.
+*/
+bool ImgProcessing::getWarpFootprint(const cv::Mat &H, const cv::Size &src_size, const cv::Size &dst_size, ImgFootprint &footprint, int margin){
+
+  cv::Mat H_inv;
+  cv::Mat(H.inv()).convertTo(H_inv, CV_64F);
+
+  float dst_corners[4][2] = {{0, 0}, {static_cast<float>(dst_size.width-1), 0},
+			     {static_cast<float>(dst_size.width-1), static_cast<float>(dst_size.height-1)},
+			     {0, static_cast<float>(dst_size.height-1)}};
+
+  //Project destination corners into the source image, a corner behind the camera makes the quadrilateral meaningless
+  std::vector<cv::Point2f> poly;
+  for(int i = 0 ; i < 4 ; i++){
+    const double *h0 = H_inv.ptr<double>(0);
+    const double *h1 = H_inv.ptr<double>(1);
+    const double *h2 = H_inv.ptr<double>(2);
+    double w = h2[0]*dst_corners[i][0] + h2[1]*dst_corners[i][1] + h2[2];
+
+    if(w <= 0){
+      footprint = ImgFootprint(src_size);
+      return true;
+    }
+    poly.push_back(cv::Point2f((h0[0]*dst_corners[i][0] + h0[1]*dst_corners[i][1] + h0[2])/w,
+			       (h1[0]*dst_corners[i][0] + h1[1]*dst_corners[i][1] + h1[2])/w));
+  }
+
+  //Clip the quadrilateral against the source image borders (Sutherland-Hodgman)
+  float bounds[4] = {0, 0, static_cast<float>(src_size.width-1), static_cast<float>(src_size.height-1)};
+
+  for(int b = 0 ; b < 4 && !poly.empty() ; b++){
+    std::vector<cv::Point2f> clipped;
+    int axis = b % 2;
+    float sign = (b < 2) ? 1.0f : -1.0f;
+
+    for(int i = 0 ; i < poly.size() ; i++){
+      cv::Point2f p1 = poly[i];
+      cv::Point2f p2 = poly[(i+1) % poly.size()];
+      float d1 = sign*((axis ? p1.y : p1.x) - bounds[b]);
+      float d2 = sign*((axis ? p2.y : p2.x) - bounds[b]);
+
+      if(d1 >= 0)
+	clipped.push_back(p1);
+      if((d1 >= 0) != (d2 >= 0)){
+	float t = d1/(d1 - d2);
+	clipped.push_back(cv::Point2f(p1.x + t*(p2.x - p1.x), p1.y + t*(p2.y - p1.y)));
+      }
+    }
+    poly = clipped;
+  }
+
+  footprint.quad = poly;
+  footprint.spans.clear();
+  footprint.bbox = cv::Rect();
+
+  if(poly.size() < 3)
+    return false;
+
+  float min_y = poly[0].y, max_y = poly[0].y;
+  for(int i = 1 ; i < poly.size() ; i++){
+    min_y = std::min(min_y, poly[i].y);
+    max_y = std::max(max_y, poly[i].y);
+  }
+
+  int first_row = std::max(0, static_cast<int>(std::ceil(min_y)));
+  int last_row = std::min(src_size.height-1, static_cast<int>(std::floor(max_y)));
+
+  if(last_row < first_row)
+    return false;
+
+  //Intersect every row with the convex polygon
+  std::vector<std::pair<int,int> > row_spans(last_row - first_row + 1);
+
+  for(int r = first_row ; r <= last_row ; r++){
+    float x_min = static_cast<float>(src_size.width);
+    float x_max = -1.0f;
+
+    for(int i = 0 ; i < poly.size() ; i++){
+      const cv::Point2f &p1 = poly[i];
+      const cv::Point2f &p2 = poly[(i+1) % poly.size()];
+
+      if((r < std::min(p1.y, p2.y)) || (r > std::max(p1.y, p2.y)))
+	continue;
+
+      if(p1.y == p2.y){
+	x_min = std::min(x_min, std::min(p1.x, p2.x));
+	x_max = std::max(x_max, std::max(p1.x, p2.x));
+      }
+      else{
+	float x = p1.x + (r - p1.y)*(p2.x - p1.x)/(p2.y - p1.y);
+	x_min = std::min(x_min, x);
+	x_max = std::max(x_max, x);
+      }
+    }
+
+    int c0 = std::max(0, static_cast<int>(std::ceil(x_min)));
+    int c1 = std::min(src_size.width, static_cast<int>(std::floor(x_max)) + 1);
+    row_spans[r - first_row] = std::pair<int,int>(c0, std::max(c0, c1));
+  }
+
+  //Shrink the footprint by the margin in both directions
+  int rows = row_spans.size();
+  int bbox_x0 = src_size.width, bbox_x1 = 0, bbox_y0 = -1, bbox_y1 = -1;
+  std::vector<std::pair<int,int> > eroded(rows);
+
+  for(int r = 0 ; r < rows ; r++){
+    int c0 = row_spans[r].first + margin;
+    int c1 = row_spans[r].second - margin;
+
+    if(r < margin || r >= rows - margin)
+      c1 = c0;
+
+    for(int k = std::max(0, r - margin) ; k <= std::min(rows - 1, r + margin) ; k++){
+      c0 = std::max(c0, row_spans[k].first + margin);
+      c1 = std::min(c1, row_spans[k].second - margin);
+    }
+    if(c1 <= c0){
+      eroded[r] = std::pair<int,int>(0, 0);
+      continue;
+    }
+    eroded[r] = std::pair<int,int>(c0, c1);
+    bbox_x0 = std::min(bbox_x0, c0);
+    bbox_x1 = std::max(bbox_x1, c1);
+    if(bbox_y0 < 0) bbox_y0 = r;
+    bbox_y1 = r;
+  }
+
+  if(bbox_y0 < 0)
+    return false;
+
+  footprint.bbox = cv::Rect(bbox_x0, first_row + bbox_y0, bbox_x1 - bbox_x0, bbox_y1 - bbox_y0 + 1);
+  footprint.spans.assign(eroded.begin() + bbox_y0, eroded.begin() + bbox_y1 + 1);
+
+  for(int r = 0 ; r < footprint.spans.size() ; r++)
+    if(footprint.spans[r].second == 0)
+      footprint.spans[r] = std::pair<int,int>(bbox_x0, bbox_x0);
+
+  return true;
+}
+
+/**
+   Function computes Otsu threshold of the grayscale image using only pixels lying inside the footprint. The image covers the footprint bounding box.
+*/
+double ImgProcessing::getFootprintOtsu(const cv::Mat &gray, const ImgFootprint &footprint){
+
+  int hist[256] = {0};
+  int N = 0;
+
+  for(int r = 0 ; r < footprint.spans.size() ; r++){
+    const uchar *row = gray.ptr<uchar>(r);
+    for(int c = footprint.spans[r].first ; c < footprint.spans[r].second ; c++)
+      hist[row[c - footprint.bbox.x]]++;
+    N += footprint.spans[r].second - footprint.spans[r].first;
+  }
+
+  if(N == 0)
+    return 0;
+
+  double mu = 0, scale = 1./N;
+  for(int i = 0 ; i < 256 ; i++)
+    mu += i*static_cast<double>(hist[i]);
+  mu *= scale;
+
+  double mu1 = 0, q1 = 0;
+  double max_sigma = 0, max_val = 0;
+
+  for(int i = 0 ; i < 256 ; i++){
+    double p_i, q2, mu2, sigma;
+
+    p_i = hist[i]*scale;
+    mu1 *= q1;
+    q1 += p_i;
+    q2 = 1. - q1;
+
+    if(std::min(q1,q2) < FLT_EPSILON || std::max(q1,q2) > 1. - FLT_EPSILON)
+      continue;
+
+    mu1 = (mu1 + i*p_i)/q1;
+    mu2 = (mu - q1*mu1)/q2;
+    sigma = q1*q2*(mu1 - mu2)*(mu1 - mu2);
+    if(sigma > max_sigma){
+      max_sigma = sigma;
+      max_val = i;
+    }
+  }
+  return max_val;
+}
+
 /**
    Function splits given string depending on defined delimeter
 */
@@ -18,6 +18,8 @@
 #include <pcl/octree/octree.h>
 
 class rayBox : public pcl::VoxelGridOcclusionEstimation<pcl::PointXYZ>{
+
+  friend class OccupancyGrid;
   
 public:
   float getBoxIntersection(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction){
@@ -55,6 +57,8 @@ public:
   ImgProcessing(MyMesh &inM) : DataProcessing(inM){};
   ImgProcessing() : DataProcessing(){};
   static bool getImgFundMat(cv::Mat, cv::Mat, cv::Mat&);
+  static bool getWarpFootprint(const cv::Mat&, const cv::Size&, const cv::Size&, ImgFootprint&, int margin = 2);
+  static double getFootprintOtsu(const cv::Mat&, const ImgFootprint&);
   cv::Mat alignImages(cv::Mat, cv::Mat);
   cv::Mat diffThres(cv::Mat, cv::Mat);
 };
@@ -89,6 +93,8 @@ void findOcc(std::map<int,int> &inMap, std::vector<int> &outVector, int noOfOut)
 /////////////////////////////////////////////////////////////////////////////////////////////////
 // BELOW UNFINISHED IMPLEMENTATION OF VISIBILITY ESTIMATION FROM THE "VISUAL TURING TEST" PAPER//
 /////////////////////////////////////////////////////////////////////////////////////////////////
+// Per vertex visibility in a camera is answered by DepthBuffer::isVisible (util/depthBuffer.hpp),
+// rendering one buffer per shot through DepthBufferCache replaces the per vertex image checks below.
 
 /*
   template <typename T>
@@ -0,0 +1,366 @@
+#include "occupancyGrid.hpp"
+#include "meshProcess.hpp"
+#include "utilIO.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+
+OccupancyGrid::OccupancyGrid(const std::string &filename, double resolution) : resolution(resolution){
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
+  MeshIO::getPlyFilePCL(filename, cloud);
+  build(cloud);
+}
+
+OccupancyGrid::OccupancyGrid(const pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud, double resolution) : resolution(resolution){
+  build(cloud);
+}
+
+/**
+   Function voxelizes the cloud and keeps a copy of the voxel grid state, the temporary rayBox is discarded afterwards.
+*/
+void OccupancyGrid::build(const pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud){
+
+  std::cout<<"Building occupancy grid of "<<cloud->points.size()<<" points, resolution "<<resolution<<"..."<<std::endl;
+
+  rayBox voxel_grid;
+  voxel_grid.setInputCloud(cloud);
+  voxel_grid.setLeafSize(resolution, resolution, resolution);
+  voxel_grid.initializeVoxelGrid();
+
+  leaf_size = voxel_grid.leaf_size_;
+  inverse_leaf_size = voxel_grid.inverse_leaf_size_;
+  min_b = voxel_grid.min_b_;
+  max_b = voxel_grid.max_b_;
+  divb_mul = voxel_grid.divb_mul_;
+  b_min = voxel_grid.b_min_;
+  b_max = voxel_grid.b_max_;
+  leaf_layout = voxel_grid.leaf_layout_;
+  centroids.assign(voxel_grid.filtered_cloud_.points.begin(), voxel_grid.filtered_cloud_.points.end());
+
+  buildBricks();
+
+  std::cout<<"Occupied voxels: "<<centroids.size()<<", bricks: "<<brick_occ.size()<<std::endl;
+}
+
+/**
+   Function builds the brick level of the grid from the leaf layout
+*/
+void OccupancyGrid::buildBricks(){
+
+  for(int d = 0 ; d < 3 ; d++)
+    brick_div[d] = (max_b[d] - min_b[d] + BRICK_SIZE) >> BRICK_SHIFT;
+
+  brick_mul = Eigen::Vector3i(1, brick_div[0], brick_div[0]*brick_div[1]);
+
+  int n_bricks = brick_div[0]*brick_div[1]*brick_div[2];
+  brick_occ.assign(n_bricks, 0);
+  brick_bits.assign(n_bricks*BRICK_WORDS, 0);
+
+  for(int idx = 0 ; idx < leaf_layout.size() ; idx++){
+
+    if(leaf_layout[idx] == -1)
+      continue;
+
+    Eigen::Vector3i rel(idx % divb_mul[1], (idx % divb_mul[2]) / divb_mul[1], idx / divb_mul[2]);
+    Eigen::Vector3i local(rel[0] & (BRICK_SIZE-1), rel[1] & (BRICK_SIZE-1), rel[2] & (BRICK_SIZE-1));
+
+    int brick = getBrickIndex(rel + min_b.head<3>());
+    int bit = (local[2]*BRICK_SIZE + local[1])*BRICK_SIZE + local[0];
+
+    brick_occ[brick]++;
+    brick_bits[brick*BRICK_WORDS + (bit >> 5)] |= 1u << (bit & 31);
+  }
+}
+
+/**
+   Function returns index of the brick containing voxel ijk, the voxel has to lie inside the grid
+*/
+int OccupancyGrid::getBrickIndex(const Eigen::Vector3i &ijk) const{
+
+  return ((ijk[0] - min_b[0]) >> BRICK_SHIFT)*brick_mul[0] +
+    ((ijk[1] - min_b[1]) >> BRICK_SHIFT)*brick_mul[1] +
+    ((ijk[2] - min_b[2]) >> BRICK_SHIFT)*brick_mul[2];
+}
+
+/**
+   Function tests the voxel bit in the brick bitmask, the voxel has to lie inside the grid
+*/
+bool OccupancyGrid::isOccupied(const Eigen::Vector3i &ijk) const{
+
+  int bit = (((ijk[2] - min_b[2]) & (BRICK_SIZE-1))*BRICK_SIZE + ((ijk[1] - min_b[1]) & (BRICK_SIZE-1)))*BRICK_SIZE + ((ijk[0] - min_b[0]) & (BRICK_SIZE-1));
+
+  return (brick_bits[getBrickIndex(ijk)*BRICK_WORDS + (bit >> 5)] >> (bit & 31)) & 1u;
+}
+
+int OccupancyGrid::getCentroidIndexAt(const Eigen::Vector3i &ijk) const{
+
+  int idx = getVoxelIndex(ijk);
+
+  if(idx < 0 || idx >= static_cast<int>(leaf_layout.size()))
+    return -1;
+
+  return leaf_layout[idx];
+}
+
+bool OccupancyGrid::isInside(const Eigen::Vector3i &ijk) const{
+  return (ijk[0] < max_b[0]+1) && (ijk[0] >= min_b[0]) &&
+    (ijk[1] < max_b[1]+1) && (ijk[1] >= min_b[1]) &&
+    (ijk[2] < max_b[2]+1) && (ijk[2] >= min_b[2]);
+}
+
+Eigen::Vector3i OccupancyGrid::getGridCoord(float x, float y, float z) const{
+  return Eigen::Vector3i(static_cast<int>(floor(x * inverse_leaf_size[0])),
+			 static_cast<int>(floor(y * inverse_leaf_size[1])),
+			 static_cast<int>(floor(z * inverse_leaf_size[2])));
+}
+
+Eigen::Vector4f OccupancyGrid::getCentroidCoordinate(const Eigen::Vector3i &ijk) const{
+
+  int i = (b_min[0] < 0) ? (abs(min_b[0]) + ijk[0]) : (ijk[0] - min_b[0]);
+  int j = (b_min[1] < 0) ? (abs(min_b[1]) + ijk[1]) : (ijk[1] - min_b[1]);
+  int k = (b_min[2] < 0) ? (abs(min_b[2]) + ijk[2]) : (ijk[2] - min_b[2]);
+
+  Eigen::Vector4f xyz;
+  xyz[0] = b_min[0] + (leaf_size[0] * 0.5f) + (static_cast<float>(i) * leaf_size[0]);
+  xyz[1] = b_min[1] + (leaf_size[1] * 0.5f) + (static_cast<float>(j) * leaf_size[1]);
+  xyz[2] = b_min[2] + (leaf_size[2] * 0.5f) + (static_cast<float>(k) * leaf_size[2]);
+  xyz[3] = 0;
+  return xyz;
+}
+
+/**
+   Function returns the ray parameter where the ray enters the bounding box of the grid or -1 if the box is missed
+*/
+float OccupancyGrid::getBoxIntersection(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction) const{
+
+  float tmin, tmax, tymin, tymax, tzmin, tzmax;
+
+  if(direction[0] >= 0){
+    tmin = (b_min[0] - origin[0]) / direction[0];
+    tmax = (b_max[0] - origin[0]) / direction[0];
+  }
+  else{
+    tmin = (b_max[0] - origin[0]) / direction[0];
+    tmax = (b_min[0] - origin[0]) / direction[0];
+  }
+
+  if(direction[1] >= 0){
+    tymin = (b_min[1] - origin[1]) / direction[1];
+    tymax = (b_max[1] - origin[1]) / direction[1];
+  }
+  else{
+    tymin = (b_max[1] - origin[1]) / direction[1];
+    tymax = (b_min[1] - origin[1]) / direction[1];
+  }
+
+  if((tmin > tymax) || (tymin > tmax))
+    return -1.0f;
+
+  if(tymin > tmin)
+    tmin = tymin;
+  if(tymax < tmax)
+    tmax = tymax;
+
+  if(direction[2] >= 0){
+    tzmin = (b_min[2] - origin[2]) / direction[2];
+    tzmax = (b_max[2] - origin[2]) / direction[2];
+  }
+  else{
+    tzmin = (b_max[2] - origin[2]) / direction[2];
+    tzmax = (b_min[2] - origin[2]) / direction[2];
+  }
+
+  if((tmin > tzmax) || (tzmin > tmax))
+    return -1.0f;
+
+  if(tzmin > tmin)
+    tmin = tzmin;
+
+  return tmin;
+}
+
+/**
+   Function traverses the grid along the ray starting at t_min and returns index of the first occupied voxel centroid or -1. If steps is given it receives the number of visited voxels.
+*/
+int OccupancyGrid::getFirstOccl(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction, const float t_min, int *steps) const{
+
+  GridTraversal ray;
+  initTraversal(origin, direction, t_min, ray);
+  return traverse(ray, steps);
+}
+
+/**
+   Function computes the entry voxel of the ray and the Amanatides-Woo stepping parameters
+*/
+void OccupancyGrid::initTraversal(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction, const float t_min, GridTraversal &ray) const{
+
+  // coordinate of the boundary of the voxel grid
+  Eigen::Vector4f start = origin + t_min * direction;
+
+  // i,j,k coordinate of the voxel were the ray enters the voxel grid
+  ray.ijk = getGridCoord(start[0], start[1], start[2]);
+
+  // the entry point lies on the grid boundary, keep it inside the grid despite rounding
+  for(int d = 0 ; d < 3 ; d++)
+    ray.ijk[d] = std::max(min_b[d], std::min(max_b[d], ray.ijk[d]));
+
+  // centroid coordinate of the entry voxel
+  Eigen::Vector4f voxel_max = getCentroidCoordinate(ray.ijk);
+
+  for(int d = 0 ; d < 3 ; d++){
+    if(direction[d] >= 0){
+      voxel_max[d] += leaf_size[d] * 0.5f;
+      ray.step[d] = 1;
+    }
+    else{
+      voxel_max[d] -= leaf_size[d] * 0.5f;
+      ray.step[d] = -1;
+    }
+    // rays parallel to the axis never step along it
+    if(direction[d] == 0){
+      ray.t_max[d] = std::numeric_limits<float>::infinity();
+      ray.t_delta[d] = std::numeric_limits<float>::infinity();
+      continue;
+    }
+    ray.t_max[d] = t_min + (voxel_max[d] - start[d]) / direction[d];
+    ray.t_delta[d] = leaf_size[d] / static_cast<float>(fabs(direction[d]));
+  }
+}
+
+/**
+   Function steps the ray through the grid until an occupied voxel is found or the ray leaves the grid
+*/
+int OccupancyGrid::traverse(GridTraversal &ray, int *steps) const{
+
+  Eigen::Vector3i &ijk = ray.ijk;
+  int visited = 0;
+  int index = -1;
+
+  while((ijk[0] < max_b[0]+1) && (ijk[0] >= min_b[0]) &&
+	(ijk[1] < max_b[1]+1) && (ijk[1] >= min_b[1]) &&
+	(ijk[2] < max_b[2]+1) && (ijk[2] >= min_b[2])){
+
+    visited++;
+    index = getCentroidIndexAt(ijk);
+    if(index != -1)
+      break;
+
+    // estimate next voxel
+    if(ray.t_max[0] <= ray.t_max[1] && ray.t_max[0] <= ray.t_max[2]){
+      ray.t_max[0] += ray.t_delta[0];
+      ijk[0] += ray.step[0];
+    }
+    else if(ray.t_max[1] <= ray.t_max[2] && ray.t_max[1] <= ray.t_max[0]){
+      ray.t_max[1] += ray.t_delta[1];
+      ijk[1] += ray.step[1];
+    }
+    else{
+      ray.t_max[2] += ray.t_delta[2];
+      ijk[2] += ray.step[2];
+    }
+  }
+
+  if(steps != NULL)
+    *steps = visited;
+
+  return index;
+}
+
+/**
+   Function moves the ray to the first voxel behind the brick it currently is in. Stepping parameters are advanced by the same accumulation as in the voxel traversal, only the lookups of the skipped voxels are left out.
+*/
+void OccupancyGrid::skipBrick(GridTraversal &ray) const{
+
+  int remaining[3];
+  float t_out[3];
+
+  for(int d = 0 ; d < 3 ; d++){
+    int local = (ray.ijk[d] - min_b[d]) & (BRICK_SIZE-1);
+    remaining[d] = (ray.step[d] > 0) ? BRICK_SIZE - local : local + 1;
+
+    // parameter where the ray crosses the brick boundary along axis d
+    t_out[d] = ray.t_max[d];
+    for(int k = 1 ; k < remaining[d] ; k++)
+      t_out[d] += ray.t_delta[d];
+  }
+
+  int exit_axis;
+  if(t_out[0] <= t_out[1] && t_out[0] <= t_out[2])
+    exit_axis = 0;
+  else if(t_out[1] <= t_out[2] && t_out[1] <= t_out[0])
+    exit_axis = 1;
+  else
+    exit_axis = 2;
+
+  float t_exit = t_out[exit_axis];
+
+  for(int d = 0 ; d < 3 ; d++){
+
+    if(d == exit_axis){
+      ray.t_max[d] = t_out[d] + ray.t_delta[d];
+      ray.ijk[d] += remaining[d]*ray.step[d];
+      continue;
+    }
+
+    // ties go to the lower axis as in the voxel traversal, axes below the exit axis step on equal parameters
+    const bool tie_steps = d < exit_axis;
+
+    for(int k = 0 ; k < remaining[d]-1 && (ray.t_max[d] < t_exit || (tie_steps && ray.t_max[d] == t_exit)) ; k++){
+      ray.t_max[d] += ray.t_delta[d];
+      ray.ijk[d] += ray.step[d];
+    }
+  }
+}
+
+/**
+   Function traverses the grid brick by brick, empty bricks are skipped and voxels are tested only inside occupied bricks. If steps is given it receives the number of visited voxels, if bricks is given it receives the number of skipped bricks.
+*/
+int OccupancyGrid::traverseBricks(GridTraversal &ray, int *steps, int *bricks) const{
+
+  Eigen::Vector3i &ijk = ray.ijk;
+  int visited = 0;
+  int skipped = 0;
+  int index = -1;
+
+  while((ijk[0] < max_b[0]+1) && (ijk[0] >= min_b[0]) &&
+	(ijk[1] < max_b[1]+1) && (ijk[1] >= min_b[1]) &&
+	(ijk[2] < max_b[2]+1) && (ijk[2] >= min_b[2])){
+
+    if(brick_occ[getBrickIndex(ijk)] == 0){
+      skipped++;
+      skipBrick(ray);
+      continue;
+    }
+
+    visited++;
+
+    if(isOccupied(ijk)){
+      index = getCentroidIndexAt(ijk);
+      break;
+    }
+
+    if(ray.t_max[0] <= ray.t_max[1] && ray.t_max[0] <= ray.t_max[2]){
+      ray.t_max[0] += ray.t_delta[0];
+      ijk[0] += ray.step[0];
+    }
+    else if(ray.t_max[1] <= ray.t_max[2] && ray.t_max[1] <= ray.t_max[0]){
+      ray.t_max[1] += ray.t_delta[1];
+      ijk[1] += ray.step[1];
+    }
+    else{
+      ray.t_max[2] += ray.t_delta[2];
+      ijk[2] += ray.step[2];
+    }
+  }
+
+  if(steps != NULL)
+    *steps = visited;
+
+  if(bricks != NULL)
+    *bricks = skipped;
+
+  return index;
+}
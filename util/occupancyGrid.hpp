@@ -0,0 +1,92 @@
+#ifndef __OCCUPANCYGRID_H_INCLUDED__
+#define __OCCUPANCYGRID_H_INCLUDED__
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <Eigen/Core>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+/**
+   State of a single ray walking through the grid with 3D-DDA.
+*/
+struct GridTraversal{
+  Eigen::Vector3i ijk;
+  Eigen::Vector3i step;
+  Eigen::Vector3f t_max;
+  Eigen::Vector3f t_delta;
+};
+
+/**
+   Voxel occupancy of the model used for ray shooting. The grid is built once per model and resolution and never modified afterwards, so a single instance can be shared by all projections and queried from several threads at once.
+
+   Voxels are additionally grouped into bricks of BRICK_SIZE^3. Every brick stores an occupancy flag and a bitmask of its voxels, the hierarchical traversal jumps over empty bricks in one step.
+*/
+class OccupancyGrid{
+
+public:
+  static const int BRICK_SHIFT = 3;
+  static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+  static const int BRICK_WORDS = BRICK_SIZE*BRICK_SIZE*BRICK_SIZE/32;
+
+  typedef boost::shared_ptr<OccupancyGrid> Ptr;
+  typedef boost::shared_ptr<const OccupancyGrid> ConstPtr;
+
+  OccupancyGrid(const std::string &filename, double resolution);
+  OccupancyGrid(const pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud, double resolution);
+
+  double getResolution() const {return resolution;}
+  std::size_t size() const {return centroids.size();}
+  const pcl::PointXYZ& getPoint(int idx) const {return centroids[idx];}
+
+  float getBoxIntersection(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction) const;
+  int getFirstOccl(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction, const float t_min, int *steps = NULL) const;
+  void initTraversal(const Eigen::Vector4f &origin, const Eigen::Vector4f &direction, const float t_min, GridTraversal &ray) const;
+  int traverse(GridTraversal &ray, int *steps = NULL) const;
+  int traverseBricks(GridTraversal &ray, int *steps = NULL, int *bricks = NULL) const;
+  void skipBrick(GridTraversal &ray) const;
+  int getBrickIndex(const Eigen::Vector3i &ijk) const;
+  bool isOccupied(const Eigen::Vector3i &ijk) const;
+  int getCentroidIndexAt(const Eigen::Vector3i &ijk) const;
+  int getVoxelIndex(const Eigen::Vector3i &ijk) const {return (ijk - min_b.head<3>()).dot(divb_mul.head<3>());}
+  bool isInside(const Eigen::Vector3i &ijk) const;
+  Eigen::Vector3i getGridCoord(float x, float y, float z) const;
+  Eigen::Vector4f getCentroidCoordinate(const Eigen::Vector3i &ijk) const;
+
+  const std::vector<int>& getLeafLayout() const {return leaf_layout;}
+  const Eigen::Vector4f& getLeafSize() const {return leaf_size;}
+  const Eigen::Vector4i& getMinBox() const {return min_b;}
+  const Eigen::Vector4i& getMaxBox() const {return max_b;}
+  const Eigen::Vector4i& getDivisionMultiplier() const {return divb_mul;}
+  const Eigen::Vector3i& getBrickMultiplier() const {return brick_mul;}
+  const std::vector<int>& getBrickOccupancy() const {return brick_occ;}
+  const std::vector<unsigned int>& getBrickBits() const {return brick_bits;}
+
+private:
+  void build(const pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud);
+  void buildBricks();
+
+  double resolution;
+  Eigen::Vector4f leaf_size;
+  Eigen::Array4f inverse_leaf_size;
+  Eigen::Vector4i min_b, max_b, divb_mul;
+  //Bounds of the grid in world coordinates
+  Eigen::Vector4f b_min, b_max;
+  //Index of the centroid of every voxel, -1 for empty voxels
+  std::vector<int> leaf_layout;
+  std::vector<pcl::PointXYZ, Eigen::aligned_allocator<pcl::PointXYZ> > centroids;
+  //Number of bricks along every axis and multipliers of the brick index
+  Eigen::Vector3i brick_div, brick_mul;
+  //Number of occupied voxels of every brick
+  std::vector<int> brick_occ;
+  //Voxel bitmask of every brick, BRICK_WORDS words per brick, bit (z*BRICK_SIZE + y)*BRICK_SIZE + x
+  std::vector<unsigned int> brick_bits;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
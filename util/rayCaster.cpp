@@ -0,0 +1,579 @@
+#include "rayCaster.hpp"
+#include "spanMask.hpp"
+#include "meshProcess.hpp"
+#include "distanceField.hpp"
+#include "maskComponents.hpp"
+#include "rayGenerator.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+   Function traverses up to PACKET_SIZE rays sharing the origin. For every ray the index of the first occupied voxel centroid (-1 if none) and the number of visited cells (voxels and skipped bricks) are written to the output arrays.
+*/
+void RayCaster::castPacket(const Eigen::Vector4f &origin, const float *dir_x, const float *dir_y, const float *dir_z, int n, int *out_idx, int *out_steps, int *out_bricks) const{
+
+  GridTraversal rays[PACKET_SIZE];
+  bool active[PACKET_SIZE];
+
+  for(int l = 0 ; l < PACKET_SIZE ; l++){
+    active[l] = false;
+
+    if(l >= n)
+      continue;
+
+    Eigen::Vector4f direction(dir_x[l], dir_y[l], dir_z[l], 0);
+    float t_min = grid.getBoxIntersection(origin, direction);
+
+    out_idx[l] = -1;
+    out_steps[l] = 0;
+    if(out_bricks != NULL)
+      out_bricks[l] = 0;
+
+    if(t_min == -1.0f)
+      continue;
+
+    if(distance_field != NULL){
+      out_idx[l] = distance_field->trace(origin, direction, t_min, &out_steps[l]);
+      continue;
+    }
+
+    grid.initTraversal(origin, direction, t_min, rays[l]);
+    active[l] = true;
+  }
+
+  if(distance_field != NULL)
+    return;
+
+#ifdef __AVX2__
+
+  int lane_ijk[3][PACKET_SIZE], lane_step[3][PACKET_SIZE], lane_active[PACKET_SIZE];
+  float lane_tmax[3][PACKET_SIZE], lane_tdelta[3][PACKET_SIZE];
+
+  for(int l = 0 ; l < PACKET_SIZE ; l++){
+    lane_active[l] = active[l] ? -1 : 0;
+    for(int d = 0 ; d < 3 ; d++){
+      lane_ijk[d][l] = active[l] ? rays[l].ijk[d] : 0;
+      lane_step[d][l] = active[l] ? rays[l].step[d] : 0;
+      lane_tmax[d][l] = active[l] ? rays[l].t_max[d] : 0;
+      lane_tdelta[d][l] = active[l] ? rays[l].t_delta[d] : 0;
+    }
+  }
+
+  const std::vector<int> &layout = grid.getLeafLayout();
+  const std::vector<int> &brick_occ = grid.getBrickOccupancy();
+  const std::vector<unsigned int> &brick_bits = grid.getBrickBits();
+  const Eigen::Vector4i &min_b = grid.getMinBox();
+  const Eigen::Vector4i &max_b = grid.getMaxBox();
+  const Eigen::Vector4i &divb_mul = grid.getDivisionMultiplier();
+  const Eigen::Vector3i &brick_mul = grid.getBrickMultiplier();
+
+  __m256i ijk[3], step[3], lo[3], hi[3], mul[3], bmul[3];
+  __m256 tmax[3], tdelta[3];
+
+  for(int d = 0 ; d < 3 ; d++){
+    ijk[d] = _mm256_loadu_si256((const __m256i*)lane_ijk[d]);
+    step[d] = _mm256_loadu_si256((const __m256i*)lane_step[d]);
+    tmax[d] = _mm256_loadu_ps(lane_tmax[d]);
+    tdelta[d] = _mm256_loadu_ps(lane_tdelta[d]);
+    // ijk >= min_b  <=>  ijk > min_b-1,  ijk < max_b+1
+    lo[d] = _mm256_set1_epi32(min_b[d] - 1);
+    hi[d] = _mm256_set1_epi32(max_b[d] + 1);
+    mul[d] = _mm256_set1_epi32(divb_mul[d]);
+    bmul[d] = _mm256_set1_epi32(brick_mul[d]);
+  }
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i brick_mask = _mm256_set1_epi32(OccupancyGrid::BRICK_SIZE - 1);
+  const __m256i brick_size = _mm256_set1_epi32(OccupancyGrid::BRICK_SIZE);
+  __m256i act = _mm256_loadu_si256((const __m256i*)lane_active);
+  __m256i result = minus_one;
+  __m256i visited = zero;
+  __m256i skipped = zero;
+
+  while(!_mm256_testz_si256(act, act)){
+
+    // lanes that left the grid are finished
+    for(int d = 0 ; d < 3 ; d++)
+      act = _mm256_and_si256(act, _mm256_and_si256(_mm256_cmpgt_epi32(ijk[d], lo[d]), _mm256_cmpgt_epi32(hi[d], ijk[d])));
+
+    if(_mm256_testz_si256(act, act))
+      break;
+
+    __m256i rel[3];
+    for(int d = 0 ; d < 3 ; d++)
+      rel[d] = _mm256_sub_epi32(ijk[d], _mm256_add_epi32(lo[d], one));
+
+    __m256i idx = _mm256_mullo_epi32(rel[0], mul[0]);
+    idx = _mm256_add_epi32(idx, _mm256_mullo_epi32(rel[1], mul[1]));
+    idx = _mm256_add_epi32(idx, _mm256_mullo_epi32(rel[2], mul[2]));
+
+    // lanes standing on an occupied voxel, lanes in empty bricks
+    __m256i occupied, empty;
+
+    if(skip_empty){
+      __m256i bidx = _mm256_mullo_epi32(_mm256_srai_epi32(rel[0], OccupancyGrid::BRICK_SHIFT), bmul[0]);
+      bidx = _mm256_add_epi32(bidx, _mm256_mullo_epi32(_mm256_srai_epi32(rel[1], OccupancyGrid::BRICK_SHIFT), bmul[1]));
+      bidx = _mm256_add_epi32(bidx, _mm256_mullo_epi32(_mm256_srai_epi32(rel[2], OccupancyGrid::BRICK_SHIFT), bmul[2]));
+
+      __m256i bocc = _mm256_mask_i32gather_epi32(zero, &brick_occ[0], bidx, act, 4);
+      empty = _mm256_and_si256(act, _mm256_cmpeq_epi32(bocc, zero));
+      __m256i full = _mm256_andnot_si256(empty, act);
+
+      __m256i bit = _mm256_and_si256(rel[2], brick_mask);
+      bit = _mm256_add_epi32(_mm256_slli_epi32(bit, OccupancyGrid::BRICK_SHIFT), _mm256_and_si256(rel[1], brick_mask));
+      bit = _mm256_add_epi32(_mm256_slli_epi32(bit, OccupancyGrid::BRICK_SHIFT), _mm256_and_si256(rel[0], brick_mask));
+
+      __m256i word_idx = _mm256_add_epi32(_mm256_mullo_epi32(bidx, _mm256_set1_epi32(OccupancyGrid::BRICK_WORDS)), _mm256_srli_epi32(bit, 5));
+      __m256i word = _mm256_mask_i32gather_epi32(zero, (const int*)&brick_bits[0], word_idx, full, 4);
+      word = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(bit, _mm256_set1_epi32(31))), one);
+      occupied = _mm256_and_si256(full, _mm256_cmpeq_epi32(word, one));
+    }
+    else{
+      empty = zero;
+      occupied = act;
+    }
+
+    // lanes in empty bricks skip the brick instead of visiting the voxel
+    visited = _mm256_sub_epi32(visited, _mm256_andnot_si256(empty, act));
+    skipped = _mm256_sub_epi32(skipped, empty);
+
+    __m256i leaf = _mm256_mask_i32gather_epi32(minus_one, &layout[0], idx, occupied, 4);
+
+    __m256i hit = _mm256_and_si256(occupied, _mm256_cmpgt_epi32(leaf, minus_one));
+    result = _mm256_blendv_epi8(result, leaf, hit);
+    act = _mm256_andnot_si256(hit, act);
+
+    // estimate next voxel, same axis priority as the scalar traversal
+    __m256 x_le_y = _mm256_cmp_ps(tmax[0], tmax[1], _CMP_LE_OQ);
+    __m256 x_le_z = _mm256_cmp_ps(tmax[0], tmax[2], _CMP_LE_OQ);
+    __m256 y_le_z = _mm256_cmp_ps(tmax[1], tmax[2], _CMP_LE_OQ);
+    __m256 y_le_x = _mm256_cmp_ps(tmax[1], tmax[0], _CMP_LE_OQ);
+
+    __m256 move_x = _mm256_and_ps(x_le_y, x_le_z);
+    __m256 move_y = _mm256_andnot_ps(move_x, _mm256_and_ps(y_le_z, y_le_x));
+    __m256 move_z = _mm256_andnot_ps(_mm256_or_ps(move_x, move_y), _mm256_castsi256_ps(minus_one));
+    __m256 moves[3] = {move_x, move_y, move_z};
+
+    __m256 voxel_lanes = _mm256_castsi256_ps(_mm256_andnot_si256(empty, act));
+
+    for(int d = 0 ; d < 3 ; d++){
+      moves[d] = _mm256_and_ps(moves[d], voxel_lanes);
+      tmax[d] = _mm256_blendv_ps(tmax[d], _mm256_add_ps(tmax[d], tdelta[d]), moves[d]);
+      ijk[d] = _mm256_add_epi32(ijk[d], _mm256_and_si256(step[d], _mm256_castps_si256(moves[d])));
+    }
+
+    if(_mm256_testz_si256(empty, empty))
+      continue;
+
+    // jump over empty bricks, see OccupancyGrid::skipBrick
+    __m256i remaining[3];
+    __m256 t_out[3];
+
+    for(int d = 0 ; d < 3 ; d++){
+      __m256i local = _mm256_and_si256(rel[d], brick_mask);
+      remaining[d] = _mm256_blendv_epi8(_mm256_add_epi32(local, one), _mm256_sub_epi32(brick_size, local), _mm256_cmpgt_epi32(step[d], zero));
+
+      t_out[d] = tmax[d];
+      for(int k = 1 ; k < OccupancyGrid::BRICK_SIZE ; k++){
+	__m256 cond = _mm256_castsi256_ps(_mm256_cmpgt_epi32(remaining[d], _mm256_set1_epi32(k)));
+	t_out[d] = _mm256_blendv_ps(t_out[d], _mm256_add_ps(t_out[d], tdelta[d]), cond);
+      }
+    }
+
+    __m256 exit_x = _mm256_and_ps(_mm256_cmp_ps(t_out[0], t_out[1], _CMP_LE_OQ), _mm256_cmp_ps(t_out[0], t_out[2], _CMP_LE_OQ));
+    __m256 exit_y = _mm256_andnot_ps(exit_x, _mm256_and_ps(_mm256_cmp_ps(t_out[1], t_out[2], _CMP_LE_OQ), _mm256_cmp_ps(t_out[1], t_out[0], _CMP_LE_OQ)));
+    __m256 exit_z = _mm256_andnot_ps(_mm256_or_ps(exit_x, exit_y), _mm256_castsi256_ps(minus_one));
+    __m256 exits[3] = {exit_x, exit_y, exit_z};
+    // ties go to the lower axis as in the voxel traversal, axes below the exit axis step on equal parameters
+    __m256 ties[3] = {_mm256_andnot_ps(exit_x, _mm256_castsi256_ps(minus_one)), exit_z, _mm256_setzero_ps()};
+
+    __m256 t_exit = _mm256_blendv_ps(_mm256_blendv_ps(t_out[2], t_out[1], exit_y), t_out[0], exit_x);
+
+    for(int d = 0 ; d < 3 ; d++){
+      __m256i exit_lanes = _mm256_and_si256(_mm256_castps_si256(exits[d]), empty);
+      tmax[d] = _mm256_blendv_ps(tmax[d], _mm256_add_ps(t_out[d], tdelta[d]), _mm256_castsi256_ps(exit_lanes));
+      ijk[d] = _mm256_add_epi32(ijk[d], _mm256_and_si256(_mm256_mullo_epi32(remaining[d], step[d]), exit_lanes));
+
+      __m256i other_lanes = _mm256_andnot_si256(exit_lanes, empty);
+      __m256i last = _mm256_sub_epi32(remaining[d], one);
+
+      for(int k = 0 ; k < OccupancyGrid::BRICK_SIZE-1 ; k++){
+	__m256i cond = _mm256_and_si256(other_lanes, _mm256_cmpgt_epi32(last, _mm256_set1_epi32(k)));
+	__m256 before = _mm256_or_ps(_mm256_cmp_ps(tmax[d], t_exit, _CMP_LT_OQ), _mm256_and_ps(ties[d], _mm256_cmp_ps(tmax[d], t_exit, _CMP_EQ_OQ)));
+	cond = _mm256_and_si256(cond, _mm256_castps_si256(before));
+	tmax[d] = _mm256_blendv_ps(tmax[d], _mm256_add_ps(tmax[d], tdelta[d]), _mm256_castsi256_ps(cond));
+	ijk[d] = _mm256_add_epi32(ijk[d], _mm256_and_si256(step[d], cond));
+      }
+    }
+  }
+
+  int lane_result[PACKET_SIZE], lane_visited[PACKET_SIZE], lane_skipped[PACKET_SIZE];
+  _mm256_storeu_si256((__m256i*)lane_result, result);
+  _mm256_storeu_si256((__m256i*)lane_visited, visited);
+  _mm256_storeu_si256((__m256i*)lane_skipped, skipped);
+
+  for(int l = 0 ; l < n ; l++){
+    out_idx[l] = lane_result[l];
+    out_steps[l] = lane_visited[l];
+    if(out_bricks != NULL)
+      out_bricks[l] = lane_skipped[l];
+  }
+
+#else
+
+  for(int l = 0 ; l < n ; l++)
+    if(active[l])
+      out_idx[l] = skip_empty ? grid.traverseBricks(rays[l], &out_steps[l], out_bricks != NULL ? &out_bricks[l] : NULL) : grid.traverse(rays[l], &out_steps[l]);
+
+#endif
+}
+
+/**
+   Function shoots a ray through every changed pixel of the mask. Output arrays follow the pixel order of the mask, steps holds the visited voxels and bricks, if given, the skipped empty bricks of every ray.
+*/
+void RayCaster::castMask(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, std::vector<int> &steps, std::vector<int> *bricks) const{
+
+  const int n_pts = chng_mask.count();
+  const int n_packets = (n_pts + PACKET_SIZE - 1) / PACKET_SIZE;
+
+  hit_idx.assign(n_pts, -1);
+  steps.assign(n_pts, 0);
+  if(bricks != NULL)
+    bricks->assign(n_pts, 0);
+
+  if(n_pts == 0)
+    return;
+
+  //Directions of all the rays, generated span by span
+  const CameraRayGenerator ray_gen(shot);
+  const std::vector<MaskSpan> &spans = chng_mask.getSpans();
+  std::vector<int> span_offset(spans.size() + 1, 0);
+
+  for(int s = 0 ; s < spans.size() ; s++)
+    span_offset[s+1] = span_offset[s] + spans[s].size();
+
+  std::vector<float> dir_x(n_pts), dir_y(n_pts), dir_z(n_pts);
+
+#pragma omp parallel for schedule(dynamic, 64)
+  for(int s = 0 ; s < spans.size() ; s++)
+    ray_gen.generateSpan(spans[s].row, spans[s].first, spans[s].last, &dir_x[span_offset[s]], &dir_y[span_offset[s]], &dir_z[span_offset[s]]);
+
+#pragma omp parallel for schedule(dynamic, TILE_PACKETS)
+  for(int p = 0 ; p < n_packets ; p++){
+    const int first = p * PACKET_SIZE;
+    castPacket(ray_gen.getOrigin(), &dir_x[first], &dir_y[first], &dir_z[first], std::min(PACKET_SIZE, n_pts - first), &hit_idx[first], &steps[first], bricks != NULL ? &(*bricks)[first] : NULL);
+  }
+}
+
+/**
+   Function shoots a ray through every image point (x=column, y=row). Output arrays follow the order of the points.
+*/
+void RayCaster::castPoints(const std::vector<cv::Point2f> &pts, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, std::vector<int> &steps) const{
+
+  const int n_pts = pts.size();
+  const int n_packets = (n_pts + PACKET_SIZE - 1) / PACKET_SIZE;
+
+  hit_idx.assign(n_pts, -1);
+  steps.assign(n_pts, 0);
+
+  if(n_pts == 0)
+    return;
+
+  const CameraRayGenerator ray_gen(shot);
+
+#pragma omp parallel for schedule(dynamic, TILE_PACKETS)
+  for(int p = 0 ; p < n_packets ; p++){
+
+    float dir_x[PACKET_SIZE], dir_y[PACKET_SIZE], dir_z[PACKET_SIZE];
+    const int first = p * PACKET_SIZE;
+    const int n = std::min(PACKET_SIZE, n_pts - first);
+
+    ray_gen.generate(&pts[first], n, dir_x, dir_y, dir_z);
+    castPacket(ray_gen.getOrigin(), dir_x, dir_y, dir_z, n, &hit_idx[first], &steps[first]);
+  }
+}
+
+/**
+   Function projects the mask component by component. Rays are shot only through the boundary of every component and through its interior pixels on a grid of the given stride. The hit voxels are then grown through the occupied neighbouring voxels which project into the same component and whose distance from the camera lies within the distance range of the component hits. Every reached voxel is written once to hit_idx. Function returns the number of rays shot.
+*/
+int RayCaster::castComponents(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, int stride) const{
+
+  hit_idx.clear();
+
+  MaskComponents components(chng_mask);
+  std::vector<cv::Point2f> pts;
+  std::vector<int> labels, seeds, steps;
+
+  components.getSamples(stride, pts, labels);
+  castPoints(pts, shot, seeds, steps);
+
+  const vcg::Point3f origin = shot.Extrinsics.Tra();
+  const float tolerance = 2.0f*grid.getResolution();
+
+  //Distance range of the hits of every component
+  std::vector<float> min_dist(components.size(), std::numeric_limits<float>::max());
+  std::vector<float> max_dist(components.size(), -std::numeric_limits<float>::max());
+
+  boost::unordered_map<int, int> voxel_label;
+  std::vector<int> queue;
+
+  for(int k = 0 ; k < seeds.size() ; k++){
+
+    if(seeds[k] == -1)
+      continue;
+
+    float dist = (PclProcessing::pcl2vcgPt(grid.getPoint(seeds[k])) - origin).Norm();
+    min_dist[labels[k]] = std::min(min_dist[labels[k]], dist);
+    max_dist[labels[k]] = std::max(max_dist[labels[k]], dist);
+
+    if(voxel_label.insert(std::make_pair(seeds[k], labels[k])).second)
+      queue.push_back(seeds[k]);
+  }
+
+  //Breadth first growth over the 26-neighbourhood of the voxels
+  for(int head = 0 ; head < queue.size() ; head++){
+
+    const pcl::PointXYZ &pt = grid.getPoint(queue[head]);
+    const Eigen::Vector3i ijk = grid.getGridCoord(pt.x, pt.y, pt.z);
+    const int label = voxel_label[queue[head]];
+
+    for(int dz = -1 ; dz <= 1 ; dz++)
+      for(int dy = -1 ; dy <= 1 ; dy++)
+	for(int dx = -1 ; dx <= 1 ; dx++){
+
+	  Eigen::Vector3i nb = ijk + Eigen::Vector3i(dx, dy, dz);
+	  if(!grid.isInside(nb))
+	    continue;
+
+	  int nb_idx = grid.getCentroidIndexAt(nb);
+	  if(nb_idx == -1 || voxel_label.count(nb_idx))
+	    continue;
+
+	  vcg::Point3f nb_pt = PclProcessing::pcl2vcgPt(grid.getPoint(nb_idx));
+	  float dist = (nb_pt - origin).Norm();
+	  if(dist < min_dist[label] - tolerance || dist > max_dist[label] + tolerance)
+	    continue;
+
+	  vcg::Point2f px = shot.Project(nb_pt);
+	  if(components.getLabel(static_cast<int>(px[1] + 0.5f), static_cast<int>(px[0] + 0.5f)) != label)
+	    continue;
+
+	  voxel_label[nb_idx] = label;
+	  queue.push_back(nb_idx);
+	}
+  }
+
+  hit_idx.swap(queue);
+  return pts.size();
+}
+
+/**
+   Rectangle of mask pixels refined by adaptive casting
+*/
+struct AdaptiveCell{
+  int x, y, w, h, depth;
+
+  AdaptiveCell(int in_x, int in_y, int in_w, int in_h, int in_depth) : x(in_x), y(in_y), w(in_w), h(in_h), depth(in_depth){}
+};
+
+// Coverage of an adaptive cell by the mask
+enum cell_coverage{CELL_OUTSIDE, CELL_PARTIAL, CELL_INSIDE};
+
+/**
+   Function casts the mask adaptively. The bounding box of the mask is covered with cells of the given stride (at least 1) and rays are shot through the corners of the cells lying completely inside the mask. When all four corner rays hit voxels that are at most one voxel apart, the occupied voxels between them are taken as the hits of the whole cell. Cells crossed by the mask boundary or with diverging corner hits are split into four, up to max_depth times, then their pixels are shot one by one. Every reached voxel is written once to hit_idx. Function returns the number of rays shot.
+*/
+int RayCaster::castAdaptive(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, int stride, int max_depth) const{
+
+  hit_idx.clear();
+
+  if(chng_mask.empty())
+    return 0;
+
+  stride = std::max(1, stride);
+
+  const int cols = chng_mask.cols();
+  const std::vector<MaskSpan> &spans = chng_mask.getSpans();
+
+  //Bounding box of the mask, spans are ordered by rows
+  const int y0 = spans.front().row, y1 = spans.back().row + 1;
+  int x0 = cols, x1 = 0;
+  for(int s = 0 ; s < spans.size() ; s++){
+    x0 = std::min(x0, spans[s].first);
+    x1 = std::max(x1, spans[s].last);
+  }
+
+  const int box_w = x1 - x0, box_h = y1 - y0;
+  const int sat_step = box_w + 1;
+
+  //Summed area table of the mask within its bounding box, cells are classified in constant time
+  std::vector<int> sat((box_h + 1)*sat_step, 0);
+  std::vector<int> row_delta(box_w + 1);
+
+  for(int r = 0, s = 0 ; r < box_h ; r++){
+
+    std::fill(row_delta.begin(), row_delta.end(), 0);
+    for(; s < spans.size() && spans[s].row == y0 + r ; s++){
+      row_delta[spans[s].first - x0]++;
+      row_delta[spans[s].last - x0]--;
+    }
+
+    int on = 0, row_sum = 0;
+    for(int c = 0 ; c < box_w ; c++){
+      on += row_delta[c];
+      row_sum += on;
+      sat[(r+1)*sat_step + c + 1] = sat[r*sat_step + c + 1] + row_sum;
+    }
+  }
+
+  std::vector<AdaptiveCell> cells, next_cells;
+
+  for(int y = y0 ; y < y1 ; y += stride)
+    for(int x = x0 ; x < x1 ; x += stride)
+      cells.push_back(AdaptiveCell(x, y, std::min(stride, x1 - x), std::min(stride, y1 - y), 0));
+
+  boost::unordered_map<int, int> corner_hits;
+  boost::unordered_set<int> voxels;
+  std::vector<cv::Point2f> exact_pts;
+  int n_rays = 0;
+
+  while(!cells.empty()){
+
+    //Corners of the cells covered by the mask, shared corners are shot once
+    std::vector<cv::Point2f> corner_pts;
+    std::vector<int> corner_keys;
+    std::vector<unsigned char> covered(cells.size());
+
+    for(int k = 0 ; k < cells.size() ; k++){
+
+      const AdaptiveCell &cell = cells[k];
+      const int cx = cell.x - x0, cy = cell.y - y0;
+      int count = sat[(cy + cell.h)*sat_step + cx + cell.w] - sat[cy*sat_step + cx + cell.w] - sat[(cy + cell.h)*sat_step + cx] + sat[cy*sat_step + cx];
+
+      covered[k] = (count == cell.w*cell.h) ? CELL_INSIDE : (count > 0 ? CELL_PARTIAL : CELL_OUTSIDE);
+      if(covered[k] != CELL_INSIDE)
+	continue;
+
+      const int xs[2] = {cell.x, cell.x + cell.w - 1};
+      const int ys[2] = {cell.y, cell.y + cell.h - 1};
+
+      for(int a = 0 ; a < 2 ; a++)
+	for(int b = 0 ; b < 2 ; b++){
+	  int key = ys[a]*cols + xs[b];
+	  if(corner_hits.insert(std::make_pair(key, -1)).second){
+	    corner_pts.push_back(cv::Point2f(xs[b], ys[a]));
+	    corner_keys.push_back(key);
+	  }
+	}
+    }
+
+    std::vector<int> corner_idx, corner_steps;
+    castPoints(corner_pts, shot, corner_idx, corner_steps);
+    n_rays += corner_pts.size();
+
+    for(int p = 0 ; p < corner_keys.size() ; p++)
+      corner_hits[corner_keys[p]] = corner_idx[p];
+
+    next_cells.clear();
+
+    for(int k = 0 ; k < cells.size() ; k++){
+
+      const AdaptiveCell &cell = cells[k];
+
+      //Cell is outside of the mask
+      if(covered[k] == CELL_OUTSIDE)
+	continue;
+
+      if(covered[k] == CELL_INSIDE){
+
+	const int keys[4] = {cell.y*cols + cell.x, cell.y*cols + cell.x + cell.w - 1, (cell.y + cell.h - 1)*cols + cell.x, (cell.y + cell.h - 1)*cols + cell.x + cell.w - 1};
+	Eigen::Vector3i ijk_min, ijk_max;
+	bool coherent = true;
+
+	for(int c = 0 ; c < 4 && coherent ; c++){
+	  int idx = corner_hits[keys[c]];
+	  if(idx == -1){
+	    coherent = false;
+	    break;
+	  }
+	  const pcl::PointXYZ &pt = grid.getPoint(idx);
+	  Eigen::Vector3i ijk = grid.getGridCoord(pt.x, pt.y, pt.z);
+	  ijk_min = (c == 0) ? ijk : Eigen::Vector3i(ijk_min.cwiseMin(ijk));
+	  ijk_max = (c == 0) ? ijk : Eigen::Vector3i(ijk_max.cwiseMax(ijk));
+	}
+
+	if(coherent && (ijk_max - ijk_min).maxCoeff() <= 1){
+	  //Surface between the corner hits, filled from the grid
+	  for(int i = ijk_min[0] ; i <= ijk_max[0] ; i++)
+	    for(int j = ijk_min[1] ; j <= ijk_max[1] ; j++)
+	      for(int l = ijk_min[2] ; l <= ijk_max[2] ; l++){
+		int idx = grid.getCentroidIndexAt(Eigen::Vector3i(i, j, l));
+		if(idx != -1)
+		  voxels.insert(idx);
+	      }
+	  continue;
+	}
+      }
+
+      if(cell.depth < max_depth && cell.w*cell.h > 1){
+	int w0 = (cell.w + 1)/2, h0 = (cell.h + 1)/2;
+	next_cells.push_back(AdaptiveCell(cell.x, cell.y, w0, h0, cell.depth + 1));
+	if(cell.w > w0)
+	  next_cells.push_back(AdaptiveCell(cell.x + w0, cell.y, cell.w - w0, h0, cell.depth + 1));
+	if(cell.h > h0)
+	  next_cells.push_back(AdaptiveCell(cell.x, cell.y + h0, w0, cell.h - h0, cell.depth + 1));
+	if(cell.w > w0 && cell.h > h0)
+	  next_cells.push_back(AdaptiveCell(cell.x + w0, cell.y + h0, cell.w - w0, cell.h - h0, cell.depth + 1));
+	continue;
+      }
+
+      //Refinement exhausted, the remaining pixels of the cell are shot one by one
+      for(int y = cell.y ; y < cell.y + cell.h ; y++)
+	for(int x = cell.x ; x < cell.x + cell.w ; x++)
+	  if(chng_mask.test(x, y) && !corner_hits.count(y*cols + x))
+	    exact_pts.push_back(cv::Point2f(x, y));
+    }
+
+    cells.swap(next_cells);
+  }
+
+  std::vector<int> exact_idx, exact_steps;
+  castPoints(exact_pts, shot, exact_idx, exact_steps);
+  n_rays += exact_pts.size();
+
+  for(int p = 0 ; p < exact_idx.size() ; p++)
+    if(exact_idx[p] != -1)
+      voxels.insert(exact_idx[p]);
+
+  //Corner rays of refined cells hit the model as well
+  for(boost::unordered_map<int, int>::const_iterator it = corner_hits.begin() ; it != corner_hits.end() ; ++it)
+    if(it->second != -1)
+      voxels.insert(it->second);
+
+  hit_idx.assign(voxels.begin(), voxels.end());
+  std::sort(hit_idx.begin(), hit_idx.end());
+  return n_rays;
+}
+
+/**
+   Function returns voxel centroids of the rays that hit the model
+*/
+std::vector<vcg::Point3f> RayCaster::getHitPoints(const std::vector<int> &hit_idx) const{
+
+  std::vector<vcg::Point3f> out_pts;
+
+  for(int i = 0 ; i < hit_idx.size() ; i++)
+    if(hit_idx[i] != -1)
+      out_pts.push_back(PclProcessing::pcl2vcgPt(grid.getPoint(hit_idx[i])));
+
+  return out_pts;
+}
@@ -0,0 +1,47 @@
+#ifndef __RAYCASTER_H_INCLUDED__
+#define __RAYCASTER_H_INCLUDED__
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+
+#include "../common/common.hpp"
+#include "occupancyGrid.hpp"
+
+class SpanMask;
+class DistanceField;
+
+/**
+   Ray casting engine over the occupancy grid. Rays of neighbouring mask pixels are grouped into packets of PACKET_SIZE and traversed together with 3D-DDA, AVX2 is used for the stepping when available. Packets are distributed over threads in tiles of TILE_PACKETS. Empty bricks of the grid are skipped unless the caster is created with skip_empty set to false. With a distance field set, rays are sphere traced one by one instead.
+*/
+class RayCaster{
+
+public:
+  static const int PACKET_SIZE = 8;
+  static const int TILE_PACKETS = 8;
+  //Stride of the interior pixels shot by component casting and of the coarse grid of adaptive casting
+  static const int SAMPLE_STRIDE = 8;
+  //Number of times adaptive casting halves a cell before shooting its pixels one by one
+  static const int REFINE_DEPTH = 2;
+
+  RayCaster(const OccupancyGrid &in_grid, bool in_skip_empty = true) : grid(in_grid), skip_empty(in_skip_empty), distance_field(NULL){}
+
+  void setDistanceField(const DistanceField *in_field){distance_field = in_field;}
+
+  void castPacket(const Eigen::Vector4f &origin, const float *dir_x, const float *dir_y, const float *dir_z, int n, int *out_idx, int *out_steps, int *out_bricks = NULL) const;
+  void castPoints(const std::vector<cv::Point2f> &pts, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, std::vector<int> &steps) const;
+  void castMask(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, std::vector<int> &steps, std::vector<int> *bricks = NULL) const;
+  int castComponents(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, int stride = SAMPLE_STRIDE) const;
+  int castAdaptive(const SpanMask &chng_mask, const vcg::Shot<float> &shot, std::vector<int> &hit_idx, int stride = SAMPLE_STRIDE, int max_depth = REFINE_DEPTH) const;
+  std::vector<vcg::Point3f> getHitPoints(const std::vector<int> &hit_idx) const;
+
+private:
+  const OccupancyGrid &grid;
+  //Jump over empty bricks of the grid instead of visiting every voxel
+  bool skip_empty;
+  //Rays are sphere traced through the distance field when set
+  const DistanceField *distance_field;
+};
+
+#endif
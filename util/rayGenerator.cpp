@@ -0,0 +1,101 @@
+#include "rayGenerator.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+CameraRayGenerator::CameraRayGenerator(const vcg::Shot<float> &shot){
+
+  const vcg::Point3f center = shot.Extrinsics.Tra();
+  origin = Eigen::Vector4f(center[0], center[1], center[2], 0);
+
+  //Shot coordinates are (row, column), corners of the viewport keep the differences well conditioned
+  const float n_rows = std::max(shot.Intrinsics.ViewportPx[1], 1);
+  const float n_cols = std::max(shot.Intrinsics.ViewportPx[0], 1);
+
+  const vcg::Point3f p00 = shot.UnProject(vcg::Point2f(0, 0), 1) - center;
+  const vcg::Point3f p10 = shot.UnProject(vcg::Point2f(n_rows, 0), 1) - center;
+  const vcg::Point3f p01 = shot.UnProject(vcg::Point2f(0, n_cols), 1) - center;
+
+  for(int d = 0 ; d < 3 ; d++){
+    base[d] = p00[d];
+    d_row[d] = (p10[d] - p00[d]) / n_rows;
+    d_col[d] = (p01[d] - p00[d]) / n_cols;
+  }
+}
+
+/**
+   Function writes the unit direction of the ray through image point (x=column, y=row)
+*/
+void CameraRayGenerator::getDirection(float x, float y, float *dir) const{
+
+  for(int d = 0 ; d < 3 ; d++)
+    dir[d] = base[d] + y*d_row[d] + x*d_col[d];
+
+  float inv_norm = 1.0f / std::sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+  for(int d = 0 ; d < 3 ; d++)
+    dir[d] *= inv_norm;
+}
+
+/**
+   Function writes unit directions of the rays through n image points
+*/
+void CameraRayGenerator::generate(const cv::Point2f *pts, int n, float *dir_x, float *dir_y, float *dir_z) const{
+
+  for(int i = 0 ; i < n ; i++){
+    float dir[3];
+    getDirection(pts[i].x, pts[i].y, dir);
+    dir_x[i] = dir[0];
+    dir_y[i] = dir[1];
+    dir_z[i] = dir[2];
+  }
+}
+
+/**
+   Function writes unit directions of the rays through pixels [first, last) of the row
+*/
+void CameraRayGenerator::generateSpan(int row, int first, int last, float *dir_x, float *dir_y, float *dir_z) const{
+
+  //Direction through column 0 of the row
+  const float row_base[3] = {base[0] + row*d_row[0], base[1] + row*d_row[1], base[2] + row*d_row[2]};
+  int c = first;
+  int i = 0;
+
+#ifdef __AVX__
+  const __m256 lane = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256 rb[3], dc[3];
+
+  for(int d = 0 ; d < 3 ; d++){
+    rb[d] = _mm256_set1_ps(row_base[d]);
+    dc[d] = _mm256_set1_ps(d_col[d]);
+  }
+
+  for(; c + 8 <= last ; c += 8, i += 8){
+    __m256 col = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(c)), lane);
+    __m256 x = _mm256_add_ps(rb[0], _mm256_mul_ps(col, dc[0]));
+    __m256 y = _mm256_add_ps(rb[1], _mm256_mul_ps(col, dc[1]));
+    __m256 z = _mm256_add_ps(rb[2], _mm256_mul_ps(col, dc[2]));
+
+    __m256 norm_sq = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_add_ps(_mm256_mul_ps(y, y), _mm256_mul_ps(z, z)));
+    __m256 inv_norm = _mm256_div_ps(one, _mm256_sqrt_ps(norm_sq));
+
+    _mm256_storeu_ps(dir_x + i, _mm256_mul_ps(x, inv_norm));
+    _mm256_storeu_ps(dir_y + i, _mm256_mul_ps(y, inv_norm));
+    _mm256_storeu_ps(dir_z + i, _mm256_mul_ps(z, inv_norm));
+  }
+#endif
+
+  for(; c < last ; c++, i++){
+    float x = row_base[0] + c*d_col[0];
+    float y = row_base[1] + c*d_col[1];
+    float z = row_base[2] + c*d_col[2];
+    float inv_norm = 1.0f / std::sqrt(x*x + y*y + z*z);
+    dir_x[i] = x*inv_norm;
+    dir_y[i] = y*inv_norm;
+    dir_z[i] = z*inv_norm;
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef __RAYGENERATOR_H_INCLUDED__
+#define __RAYGENERATOR_H_INCLUDED__
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+
+#include "../common/common.hpp"
+
+/**
+   Generator of the viewing rays of one camera. The shot has no lens distortion, so the unprojection of image point (x=column, y=row) is an affine function of its coordinates. The function, i.e. the inverse of the camera matrix, is evaluated once from the shot and the rays are then generated without going through vcg::Shot. Directions are unit length and written in structure of arrays layout, spans are generated eight pixels at once with AVX when available.
+*/
+class CameraRayGenerator{
+
+public:
+  CameraRayGenerator(const vcg::Shot<float> &shot);
+
+  const Eigen::Vector4f& getOrigin() const {return origin;}
+
+  void getDirection(float x, float y, float *dir) const;
+  void generate(const cv::Point2f *pts, int n, float *dir_x, float *dir_y, float *dir_z) const;
+  void generateSpan(int row, int first, int last, float *dir_x, float *dir_y, float *dir_z) const;
+
+private:
+  Eigen::Vector4f origin;
+  //Direction through the image origin and its change along a column and along a row
+  float base[3];
+  float d_col[3];
+  float d_row[3];
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
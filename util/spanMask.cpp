@@ -0,0 +1,145 @@
+#include "spanMask.hpp"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+SpanMask::SpanMask(const cv::Mat &mask){
+  build(mask, ImgFootprint(mask.size()));
+}
+
+SpanMask::SpanMask(const cv::Mat &mask, const ImgFootprint &footprint){
+  build(mask, footprint);
+}
+
+/**
+   Function encodes the binary mask into spans. Only rows and columns of the footprint are scanned.
+*/
+void SpanMask::build(const cv::Mat &mask, const ImgFootprint &footprint){
+
+  mask_rows = mask.rows;
+  mask_cols = mask.cols;
+  pixel_count = 0;
+  spans.clear();
+  row_first.assign(mask_rows + 1, 0);
+
+  int r = 0;
+
+  for(; r < footprint.bbox.y && r < mask_rows; r++)
+    row_first[r] = 0;
+
+  for(int k = 0; k < footprint.bbox.height; k++, r++){
+    row_first[r] = spans.size();
+    scanRow(mask.ptr<uchar>(r), r, footprint.spans[k].first, footprint.spans[k].second, spans);
+  }
+
+  for(; r <= mask_rows; r++)
+    row_first[r] = spans.size();
+
+  for(int i = 0; i < spans.size(); i++)
+    pixel_count += spans[i].size();
+}
+
+/**
+   Function appends spans of nonzero pixels of the row in the column range [first, last). Sixteen pixels are classified at once and only the run boundaries are visited one by one.
+*/
+void SpanMask::scanRow(const uchar *row, int row_idx, int first, int last, std::vector<MaskSpan> &out_spans){
+
+  int c = first;
+  int start = 0;
+  bool in_run = false;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+
+  for(; c + 16 <= last; c += 16){
+    __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + c));
+    unsigned int nonzero = ~_mm_movemask_epi8(_mm_cmpeq_epi8(px, zero)) & 0xFFFF;
+
+    //Whole block continues the current state
+    if(nonzero == (in_run ? 0xFFFFu : 0u))
+      continue;
+
+    //Bits set where a pixel differs from its left neighbor
+    unsigned int edges = (nonzero ^ ((nonzero << 1) | (in_run ? 1u : 0u))) & 0xFFFF;
+
+    while(edges){
+      int b = __builtin_ctz(edges);
+      edges &= edges - 1;
+
+      if(!in_run)
+	start = c + b;
+      else
+	out_spans.push_back(MaskSpan(row_idx, start, c + b));
+      in_run = !in_run;
+    }
+  }
+#endif
+
+  for(; c < last; c++){
+    bool on = row[c] > 0;
+
+    if(on == in_run)
+      continue;
+    if(!in_run)
+      start = c;
+    else
+      out_spans.push_back(MaskSpan(row_idx, start, c));
+    in_run = on;
+  }
+
+  if(in_run)
+    out_spans.push_back(MaskSpan(row_idx, start, last));
+}
+
+/**
+   Function checks whether pixel (x,y) of the mask is set.
+*/
+bool SpanMask::test(int x, int y) const{
+  return findSpan(x, y) >= 0;
+}
+
+/**
+   Function returns index of the span containing pixel (x,y), -1 if the pixel is not set. Spans of the row are binary searched.
+*/
+int SpanMask::findSpan(int x, int y) const{
+
+  if(y < 0 || y >= mask_rows)
+    return -1;
+
+  //Last span of the row starting at or before x
+  int lo = row_first[y], hi = row_first[y+1];
+  const int row_begin = lo;
+  while(lo < hi){
+    int mid = (lo + hi)/2;
+    if(spans[mid].first <= x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (lo > row_begin && x < spans[lo-1].last) ? lo - 1 : -1;
+}
+
+/**
+   Function writes all the changed pixels as points into a contiguous vector.
+*/
+void SpanMask::getPoints(std::vector<cv::Point2f> &pts_vector) const{
+
+  pts_vector.reserve(pts_vector.size() + pixel_count);
+
+  for(int i = 0; i < spans.size(); i++)
+    for(int c = spans[i].first; c < spans[i].last; c++)
+      pts_vector.push_back(cv::Point2f(c, spans[i].row));
+}
+
+SpanMask::const_iterator SpanMask::begin() const{
+  const MaskSpan *first = spans.empty() ? NULL : &spans[0];
+  return const_iterator(first, first + spans.size());
+}
+
+SpanMask::const_iterator SpanMask::end() const{
+  const MaskSpan *last = spans.empty() ? NULL : &spans[0] + spans.size();
+  return const_iterator(last, last);
+}
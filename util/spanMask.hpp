@@ -0,0 +1,97 @@
+#ifndef __SPANMASK_H_INCLUDED__
+#define __SPANMASK_H_INCLUDED__
+
+#include <vector>
+#include <iterator>
+#include <cstddef>
+
+#include <opencv2/core/core.hpp>
+
+#include "utilIO.hpp"
+
+/**
+   Run of changed pixels [first, last) in a single row of the mask.
+*/
+struct MaskSpan{
+  int row;
+  int first;
+  int last;
+
+  MaskSpan(){}
+  MaskSpan(int in_row, int in_first, int in_last) : row(in_row), first(in_first), last(in_last){}
+
+  int size() const {return last - first;}
+};
+
+/**
+   Run-length encoded binary change mask. Spans are stored row by row in increasing column order, so iterating them visits the changed pixels in the same order as a row-major scan of the image.
+*/
+class SpanMask{
+
+public:
+
+  /**
+     Iterator adaptor visiting every changed pixel of the mask as an image point (x=column, y=row).
+  */
+  class const_iterator{
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef cv::Point2f value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const cv::Point2f* pointer;
+    typedef cv::Point2f reference;
+
+    const_iterator() : span(NULL), span_end(NULL), x(0){}
+    const_iterator(const MaskSpan *in_span, const MaskSpan *in_end) : span(in_span), span_end(in_end), x(in_span != in_end ? in_span->first : 0){}
+
+    cv::Point2f operator*() const {return cv::Point2f(x, span->row);}
+
+    const_iterator& operator++(){
+      if(++x >= span->last){
+	++span;
+	x = (span != span_end) ? span->first : 0;
+      }
+      return *this;
+    }
+    const_iterator operator++(int){const_iterator tmp(*this); ++(*this); return tmp;}
+
+    bool operator==(const const_iterator &other) const {return span == other.span && x == other.x;}
+    bool operator!=(const const_iterator &other) const {return !(*this == other);}
+
+  private:
+    const MaskSpan *span;
+    const MaskSpan *span_end;
+    int x;
+  };
+
+  SpanMask() : mask_rows(0), mask_cols(0), pixel_count(0){}
+  SpanMask(const cv::Mat &mask);
+  SpanMask(const cv::Mat &mask, const ImgFootprint &footprint);
+
+  void build(const cv::Mat &mask, const ImgFootprint &footprint);
+
+  int rows() const {return mask_rows;}
+  int cols() const {return mask_cols;}
+  std::size_t count() const {return pixel_count;}
+  bool empty() const {return pixel_count == 0;}
+
+  const std::vector<MaskSpan>& getSpans() const {return spans;}
+  bool test(int x, int y) const;
+  int findSpan(int x, int y) const;
+  void getPoints(std::vector<cv::Point2f>&) const;
+
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  static void scanRow(const uchar *row, int row_idx, int first, int last, std::vector<MaskSpan> &out_spans);
+
+private:
+  int mask_rows;
+  int mask_cols;
+  std::size_t pixel_count;
+  std::vector<MaskSpan> spans;
+  //Index of the first span of each row, row r owns spans [row_first[r], row_first[r+1])
+  std::vector<int> row_first;
+};
+
+#endif
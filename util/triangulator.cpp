@@ -0,0 +1,257 @@
+#include "triangulator.hpp"
+#include "utilIO.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// normal equations of nearly parallel rays are singular
+static const float MIN_DET = 1e-10f;
+
+Triangulator::Triangulator(const vcg::Shot<float> &cam1, const vcg::Shot<float> &cam2, float max_reproj_err) : max_err_sq(max_reproj_err*max_reproj_err){
+
+  const vcg::Shot<float> *cams[2] = {&cam1, &cam2};
+  const vcg::Point3f c1 = cam1.Extrinsics.Tra();
+
+  for(int d = 0 ; d < 3 ; d++)
+    shift[d] = c1[d];
+
+  for(int k = 0 ; k < 2 ; k++){
+
+    cv::Mat P = ImgIO::getIntrMatrix(*cams[k])*ImgIO::getRtMatrix(*cams[k]);
+
+    // a point one unit along the viewing direction fixes the sign of the depth
+    const vcg::Point3f center = cams[k]->Extrinsics.Tra();
+    const vcg::Point3f ahead = cams[k]->UnProject(vcg::Point2f(cams[k]->Intrinsics.CenterPx[0], cams[k]->Intrinsics.CenterPx[1]), 1);
+    vcg::Point3f dir = ahead - center;
+    dir = dir / dir.Norm();
+
+    double depth = P.at<double>(2,3);
+    for(int j = 0 ; j < 3 ; j++)
+      depth += P.at<double>(2,j)*(center[j] + dir[j]);
+
+    double scale = std::sqrt(P.at<double>(2,0)*P.at<double>(2,0) + P.at<double>(2,1)*P.at<double>(2,1) + P.at<double>(2,2)*P.at<double>(2,2));
+    if(depth < 0)
+      scale = -scale;
+
+    for(int r = 0 ; r < 3 ; r++){
+      double col3 = P.at<double>(r,3);
+      for(int j = 0 ; j < 3 ; j++){
+	proj[k][r*4+j] = static_cast<float>(P.at<double>(r,j)/scale);
+	col3 += P.at<double>(r,j)*shift[j];
+      }
+      proj[k][r*4+3] = static_cast<float>(col3/scale);
+    }
+  }
+}
+
+/**
+   Function triangulates a single pair, out_pt receives the point in the shifted frame. Returns false when the pair is rejected.
+*/
+bool Triangulator::triangulatePoint(float x1, float y1, float x2, float y2, float *out_pt) const{
+
+  const float obs[4] = {x1, y1, x2, y2};
+  float m[6] = {0, 0, 0, 0, 0, 0};
+  float v[3] = {0, 0, 0};
+
+  for(int e = 0 ; e < 4 ; e++){
+    const float *P = proj[e/2];
+    const int r = e % 2;
+
+    float a = obs[e]*P[8] - P[r*4];
+    float b = obs[e]*P[9] - P[r*4+1];
+    float c = obs[e]*P[10] - P[r*4+2];
+    float d = obs[e]*P[11] - P[r*4+3];
+
+    float inv_norm = 1.0f/std::sqrt(a*a + b*b + c*c);
+    a *= inv_norm; b *= inv_norm; c *= inv_norm; d *= inv_norm;
+
+    m[0] += a*a; m[1] += a*b; m[2] += a*c;
+    m[3] += b*b; m[4] += b*c; m[5] += c*c;
+    v[0] -= a*d; v[1] -= b*d; v[2] -= c*d;
+  }
+
+  // adjugate of the symmetric matrix [m0 m1 m2; m1 m3 m4; m2 m4 m5]
+  float c00 = m[3]*m[5] - m[4]*m[4];
+  float c01 = m[2]*m[4] - m[1]*m[5];
+  float c02 = m[1]*m[4] - m[2]*m[3];
+  float c11 = m[0]*m[5] - m[2]*m[2];
+  float c12 = m[1]*m[2] - m[0]*m[4];
+  float c22 = m[0]*m[3] - m[1]*m[1];
+  float det = m[0]*c00 + m[1]*c01 + m[2]*c02;
+
+  if(!(det > MIN_DET))
+    return false;
+
+  float inv_det = 1.0f/det;
+  float X = (c00*v[0] + c01*v[1] + c02*v[2])*inv_det;
+  float Y = (c01*v[0] + c11*v[1] + c12*v[2])*inv_det;
+  float Z = (c02*v[0] + c12*v[1] + c22*v[2])*inv_det;
+
+  for(int k = 0 ; k < 2 ; k++){
+    const float *P = proj[k];
+    float w = P[8]*X + P[9]*Y + P[10]*Z + P[11];
+    if(!(w > 0))
+      return false;
+
+    float du = (P[0]*X + P[1]*Y + P[2]*Z + P[3])/w - obs[2*k];
+    float dv = (P[4]*X + P[5]*Y + P[6]*Z + P[7])/w - obs[2*k+1];
+    if(!(du*du + dv*dv <= max_err_sq))
+      return false;
+  }
+
+  out_pt[0] = X;
+  out_pt[1] = Y;
+  out_pt[2] = Z;
+
+  return true;
+}
+
+#ifdef __AVX2__
+/**
+   Function adds the normalized equation a*X + b*Y + c*Z + d = 0 of eight pairs to their normal equations
+*/
+static inline void accumulateRow(__m256 a, __m256 b, __m256 c, __m256 d, __m256 *m, __m256 *v){
+
+  __m256 inv_norm = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b)), _mm256_mul_ps(c, c))));
+  a = _mm256_mul_ps(a, inv_norm);
+  b = _mm256_mul_ps(b, inv_norm);
+  c = _mm256_mul_ps(c, inv_norm);
+  d = _mm256_mul_ps(d, inv_norm);
+
+  m[0] = _mm256_add_ps(m[0], _mm256_mul_ps(a, a));
+  m[1] = _mm256_add_ps(m[1], _mm256_mul_ps(a, b));
+  m[2] = _mm256_add_ps(m[2], _mm256_mul_ps(a, c));
+  m[3] = _mm256_add_ps(m[3], _mm256_mul_ps(b, b));
+  m[4] = _mm256_add_ps(m[4], _mm256_mul_ps(b, c));
+  m[5] = _mm256_add_ps(m[5], _mm256_mul_ps(c, c));
+  v[0] = _mm256_sub_ps(v[0], _mm256_mul_ps(a, d));
+  v[1] = _mm256_sub_ps(v[1], _mm256_mul_ps(b, d));
+  v[2] = _mm256_sub_ps(v[2], _mm256_mul_ps(c, d));
+}
+
+static inline __m256 dot4(const float *row, __m256 X, __m256 Y, __m256 Z){
+  return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row[0]), X), _mm256_mul_ps(_mm256_set1_ps(row[1]), Y)), _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row[2]), Z), _mm256_set1_ps(row[3])));
+}
+#endif
+
+/**
+   Function triangulates n pairs given in structure of arrays layout and writes the points in world coordinates. valid[i] is set to 1 for accepted pairs, rejected ones leave the output point undefined. Returns the number of accepted pairs.
+*/
+int Triangulator::triangulate(const float *x1, const float *y1, const float *x2, const float *y2, int n, float *out_x, float *out_y, float *out_z, unsigned char *valid) const{
+
+  int i = 0;
+  int accepted = 0;
+
+#ifdef __AVX2__
+
+  const __m256 min_det = _mm256_set1_ps(MIN_DET);
+  const __m256 max_err = _mm256_set1_ps(max_err_sq);
+  const __m256 zero = _mm256_setzero_ps();
+
+  for( ; i + BATCH_SIZE <= n ; i += BATCH_SIZE){
+
+    __m256 obs[4] = {_mm256_loadu_ps(x1 + i), _mm256_loadu_ps(y1 + i), _mm256_loadu_ps(x2 + i), _mm256_loadu_ps(y2 + i)};
+    __m256 m[6] = {zero, zero, zero, zero, zero, zero};
+    __m256 v[3] = {zero, zero, zero};
+
+    for(int e = 0 ; e < 4 ; e++){
+      const float *P = proj[e/2];
+      const int r = e % 2;
+      accumulateRow(_mm256_sub_ps(_mm256_mul_ps(obs[e], _mm256_set1_ps(P[8])), _mm256_set1_ps(P[r*4])),
+		    _mm256_sub_ps(_mm256_mul_ps(obs[e], _mm256_set1_ps(P[9])), _mm256_set1_ps(P[r*4+1])),
+		    _mm256_sub_ps(_mm256_mul_ps(obs[e], _mm256_set1_ps(P[10])), _mm256_set1_ps(P[r*4+2])),
+		    _mm256_sub_ps(_mm256_mul_ps(obs[e], _mm256_set1_ps(P[11])), _mm256_set1_ps(P[r*4+3])),
+		    m, v);
+    }
+
+    __m256 c00 = _mm256_sub_ps(_mm256_mul_ps(m[3], m[5]), _mm256_mul_ps(m[4], m[4]));
+    __m256 c01 = _mm256_sub_ps(_mm256_mul_ps(m[2], m[4]), _mm256_mul_ps(m[1], m[5]));
+    __m256 c02 = _mm256_sub_ps(_mm256_mul_ps(m[1], m[4]), _mm256_mul_ps(m[2], m[3]));
+    __m256 c11 = _mm256_sub_ps(_mm256_mul_ps(m[0], m[5]), _mm256_mul_ps(m[2], m[2]));
+    __m256 c12 = _mm256_sub_ps(_mm256_mul_ps(m[1], m[2]), _mm256_mul_ps(m[0], m[4]));
+    __m256 c22 = _mm256_sub_ps(_mm256_mul_ps(m[0], m[3]), _mm256_mul_ps(m[1], m[1]));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], c00), _mm256_mul_ps(m[1], c01)), _mm256_mul_ps(m[2], c02));
+
+    __m256 ok = _mm256_cmp_ps(det, min_det, _CMP_GT_OQ);
+    __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    __m256 X = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c00, v[0]), _mm256_mul_ps(c01, v[1])), _mm256_mul_ps(c02, v[2])), inv_det);
+    __m256 Y = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c01, v[0]), _mm256_mul_ps(c11, v[1])), _mm256_mul_ps(c12, v[2])), inv_det);
+    __m256 Z = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c02, v[0]), _mm256_mul_ps(c12, v[1])), _mm256_mul_ps(c22, v[2])), inv_det);
+
+    // cheirality and reprojection error in both cameras
+    for(int k = 0 ; k < 2 ; k++){
+      const float *P = proj[k];
+      __m256 w = dot4(P + 8, X, Y, Z);
+      __m256 du = _mm256_sub_ps(_mm256_div_ps(dot4(P, X, Y, Z), w), obs[2*k]);
+      __m256 dv = _mm256_sub_ps(_mm256_div_ps(dot4(P + 4, X, Y, Z), w), obs[2*k+1]);
+      __m256 err = _mm256_add_ps(_mm256_mul_ps(du, du), _mm256_mul_ps(dv, dv));
+
+      ok = _mm256_and_ps(ok, _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+      ok = _mm256_and_ps(ok, _mm256_cmp_ps(err, max_err, _CMP_LE_OQ));
+    }
+
+    _mm256_storeu_ps(out_x + i, _mm256_add_ps(X, _mm256_set1_ps(shift[0])));
+    _mm256_storeu_ps(out_y + i, _mm256_add_ps(Y, _mm256_set1_ps(shift[1])));
+    _mm256_storeu_ps(out_z + i, _mm256_add_ps(Z, _mm256_set1_ps(shift[2])));
+
+    int ok_bits = _mm256_movemask_ps(ok);
+    for(int l = 0 ; l < BATCH_SIZE ; l++){
+      valid[i+l] = (ok_bits >> l) & 1;
+      accepted += valid[i+l];
+    }
+  }
+
+#endif
+
+  for( ; i < n ; i++){
+    float pt[3];
+    valid[i] = triangulatePoint(x1[i], y1[i], x2[i], y2[i], pt);
+    if(!valid[i])
+      continue;
+
+    out_x[i] = pt[0] + shift[0];
+    out_y[i] = pt[1] + shift[1];
+    out_z[i] = pt[2] + shift[2];
+    accepted++;
+  }
+
+  return accepted;
+}
+
+/**
+   Function triangulates corresponding points of both cameras and appends the accepted ones to out_pts in the input order. Chunks of CHUNK_SIZE pairs are processed in parallel.
+*/
+void Triangulator::triangulate(const std::vector<cv::Point2f> &cam1_pts, const std::vector<cv::Point2f> &cam2_pts, std::vector<vcg::Point3f> &out_pts) const{
+
+  const int n = std::min(cam1_pts.size(), cam2_pts.size());
+
+  std::vector<float> x1(n), y1(n), x2(n), y2(n);
+  for(int i = 0 ; i < n ; i++){
+    x1[i] = cam1_pts[i].x;
+    y1[i] = cam1_pts[i].y;
+    x2[i] = cam2_pts[i].x;
+    y2[i] = cam2_pts[i].y;
+  }
+
+  std::vector<float> out_x(n), out_y(n), out_z(n);
+  std::vector<unsigned char> valid(n);
+
+  const int n_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+#pragma omp parallel for schedule(static)
+  for(int c = 0 ; c < n_chunks ; c++){
+    int first = c*CHUNK_SIZE;
+    int count = std::min(CHUNK_SIZE, n - first);
+    triangulate(&x1[first], &y1[first], &x2[first], &y2[first], count, &out_x[first], &out_y[first], &out_z[first], &valid[first]);
+  }
+
+  out_pts.reserve(out_pts.size() + n);
+  for(int i = 0 ; i < n ; i++)
+    if(valid[i])
+      out_pts.push_back(vcg::Point3f(out_x[i], out_y[i], out_z[i]));
+}
@@ -0,0 +1,35 @@
+#ifndef __TRIANGULATOR_H_INCLUDED__
+#define __TRIANGULATOR_H_INCLUDED__
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "../common/common.hpp"
+
+/**
+   Linear (DLT) triangulation of point pairs seen by two cameras in single precision. The homogeneous system of every pair is solved through its 3x3 normal equations, BATCH_SIZE pairs at once with AVX2 when available. Points behind either camera or with reprojection error above the threshold (in pixels) are rejected. Coordinates are shifted to the center of the first camera so the float precision does not depend on the placement of the scene.
+*/
+class Triangulator{
+
+public:
+  static const int BATCH_SIZE = 8;
+  //Pairs triangulated by one thread
+  static const int CHUNK_SIZE = 4096;
+
+  Triangulator(const vcg::Shot<float> &cam1, const vcg::Shot<float> &cam2, float max_reproj_err = 4.0f);
+
+  int triangulate(const float *x1, const float *y1, const float *x2, const float *y2, int n, float *out_x, float *out_y, float *out_z, unsigned char *valid) const;
+  void triangulate(const std::vector<cv::Point2f> &cam1_pts, const std::vector<cv::Point2f> &cam2_pts, std::vector<vcg::Point3f> &out_pts) const;
+
+private:
+  bool triangulatePoint(float x1, float y1, float x2, float y2, float *out_pt) const;
+
+  //Projection matrices of both cameras in the shifted frame, row-major 3x4, scaled so that points in front of the camera have positive depth
+  float proj[2][12];
+  //Center of the first camera, origin of the shifted frame
+  float shift[3];
+  float max_err_sq;
+};
+
+#endif
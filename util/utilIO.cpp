@@ -1,15 +1,23 @@
 #include "utilIO.hpp"
 #include "pbaDataInterface.h"
 #include "meshProcess.hpp"
+#include "spanMask.hpp"
+#include "occupancyGrid.hpp"
+#include "triangulator.hpp"
+#include "atomicBitset.hpp"
+#include "voxelAccumulator.hpp"
+#include "rayGenerator.hpp"
 #include "../common/globVariables.hpp"
 
 #include <pcl/filters/voxel_grid.h>
 #include <pcl/filters/voxel_grid_occlusion_estimation.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 #include "opencv2/calib3d/calib3d.hpp"
 #include <ctime>
 
@@ -64,6 +72,56 @@ void MeshIO::saveChngMask3d(const std::vector<std::vector<vcg::Point3f> > &pts_3
     savePlyFileVcg(name,m);
 }
 
+/**
+   Function saves unique 3D change points of the accumulator as red vertices, the per-vertex quality holds the number of image pairs voting for the point for the MRF stage.
+*/
+void MeshIO::saveChngMask3d(const VoxelAccumulator &chng_pts, const std::string &name){
+
+  std::cout<<"Saving change 3D mask.."<<std::endl;
+  std::vector<vcg::Point3f> pts;
+  std::vector<int> votes;
+  chng_pts.getPoints(pts, votes);
+
+  MyMesh m;
+  for(int i = 0 ; i < pts.size() ; i++){
+    MyMesh::VertexIterator vi = vcg::tri::Allocator<MyMesh>::AddVertex(m, MyMesh::CoordType(pts[i].X(), pts[i].Y(), pts[i].Z()), vcg::Color4b::Red);
+    vi->Q() = votes[i];
+  }
+
+  std::cout<<"Vertices:"<<m.VN()<<" from "<<chng_pts.getPointCount()<<" points"<<std::endl;
+  if(m.VN()>0)
+    savePlyFileVcg(name, m, vcg::tri::io::Mask::IOM_VERTCOLOR | vcg::tri::io::Mask::IOM_VERTQUALITY);
+}
+
+/**
+   Function loads a change mask cloud with the votes of its points read from the per-vertex quality. Points count once when the file has no quality property, e.g. masks not saved from a VoxelAccumulator.
+*/
+void MeshIO::getChngMaskVotes(const std::string &filename, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr out_cloud, std::vector<int> &out_votes){
+
+  pcl::PCLPointCloud2 blob;
+  out_votes.clear();
+
+  if(pcl::io::loadPLYFile(filename, blob) == -1){
+    PCL_ERROR ("Couldn't read file\n");
+    return;
+  }
+  pcl::fromPCLPointCloud2(blob, *out_cloud);
+
+  const int n_pts = out_cloud->points.size();
+  out_votes.assign(n_pts, 1);
+
+  int field = pcl::getFieldIndex(blob, "quality");
+  if(field < 0 || blob.fields[field].datatype != pcl::PCLPointField::FLOAT32)
+    return;
+
+  const unsigned int offset = blob.fields[field].offset;
+  for(int i = 0 ; i < n_pts ; i++){
+    float quality;
+    memcpy(&quality, &blob.data[i*blob.point_step + offset], sizeof(float));
+    out_votes[i] = std::max(1, static_cast<int>(quality + 0.5f));
+  }
+}
+
 /**
    Function returns K-nearest neighbors camera images for given search point
 */
@@ -118,6 +176,23 @@ void ImgIO::getPtsFromMask(const cv::Mat &mask, std::vector<cv::Point2f> &pts_ve
   }
 }
 
+/**
+   Function extracts points from the binary change mask visiting only the rows and spans of the given footprint.
+*/
+void ImgIO::getPtsFromMask(const cv::Mat &mask, const ImgFootprint &footprint, std::vector<cv::Point2f> &pts_vector){
+
+  for(int r = 0; r < footprint.bbox.height; r++){
+    const uchar *mask_row = mask.ptr<uchar>(footprint.bbox.y + r);
+    const std::pair<int,int> &span = footprint.spans[r];
+
+    for(int c = span.first; c < span.second; c++){
+      if(mask_row[c]>0){
+	pts_vector.push_back(cv::Point2f(c, footprint.bbox.y + r));
+      }
+    }
+  }
+}
+
 /**
    Function extracts rotation translation matrix [R | t] from the VCG shot structure into OpenCV Mat structure
 */
@@ -158,6 +233,13 @@ cv::Mat ImgIO::getIntrMatrix(const vcg::Shot<float> &shot){
 Function projects 2D change mask into 3D using point correspondence between SIFT features and model 3D points.
 */
 std::vector<vcg::Point3f> ImgIO::projChngMaskCorr(const cv::Mat &chng_mask, const std::vector<ImgFeature> &img_feats, const std::vector<PtCamCorr> &pts_corr, std::set<int> &out_idx){
+  return projChngMaskCorr(chng_mask, ImgFootprint(chng_mask.size()), img_feats, pts_corr, out_idx);
+}
+
+/**
+Function projects 2D change mask into 3D using point correspondences, features outside of the footprint are skipped.
+*/
+std::vector<vcg::Point3f> ImgIO::projChngMaskCorr(const cv::Mat &chng_mask, const ImgFootprint &footprint, const std::vector<ImgFeature> &img_feats, const std::vector<PtCamCorr> &pts_corr, std::set<int> &out_idx){
 
   cv::Mat mask_copy1(chng_mask.clone());
   cv::Mat mask_copy;
@@ -178,8 +260,34 @@ std::vector<vcg::Point3f> ImgIO::projChngMaskCorr(const cv::Mat &chng_mask, cons
     ImgFeature tmp_feat;
     tmp_feat = img_feats[i];
 
+    int feat_r = tmp_feat.y+chng_mask.rows/2;
+    int feat_c = tmp_feat.x+chng_mask.cols/2;
+
+    if(!footprint.contains(feat_c, feat_r))
+      continue;
+
     //Check if feature lies under change area in the change mask
-    if(mask_copy.at<uchar>(tmp_feat.y+chng_mask.rows/2, tmp_feat.x+chng_mask.cols/2) > 0){    
+    if(mask_copy.at<uchar>(feat_r, feat_c) > 0){    
+      out_pts.push_back(pts_corr[tmp_feat.idx].pts_3d);
+      out_idx.insert(tmp_feat.idx);
+    }
+  }
+  return out_pts;
+}
+
+/**
+Function projects run-length encoded 2D change mask into 3D using point correspondences.
+*/
+std::vector<vcg::Point3f> ImgIO::projChngMaskCorr(const SpanMask &chng_mask, const std::vector<ImgFeature> &img_feats, const std::vector<PtCamCorr> &pts_corr, std::set<int> &out_idx){
+
+  std::vector<vcg::Point3f> out_pts;
+  int half_rows = chng_mask.rows()/2;
+  int half_cols = chng_mask.cols()/2;
+
+  for(int i = 0 ; i < img_feats.size(); i++){
+    const ImgFeature &tmp_feat = img_feats[i];
+
+    if(chng_mask.test(tmp_feat.x+half_cols, tmp_feat.y+half_rows)){
       out_pts.push_back(pts_corr[tmp_feat.idx].pts_3d);
       out_idx.insert(tmp_feat.idx);
     }
@@ -187,63 +295,116 @@ std::vector<vcg::Point3f> ImgIO::projChngMaskCorr(const cv::Mat &chng_mask, cons
   return out_pts;
 }
 
+FeaturePixelIndex::FeaturePixelIndex(const std::vector<ImgFeature> &img_feats, const cv::Size &size) : rows(size.height), cols(size.width){
+
+  offsets.reserve(img_feats.size());
+  pt_idx.reserve(img_feats.size());
+
+  for(int i = 0 ; i < img_feats.size(); i++){
+    int feat_r = img_feats[i].y+rows/2;
+    int feat_c = img_feats[i].x+cols/2;
+
+    if(feat_r < 0 || feat_r >= rows || feat_c < 0 || feat_c >= cols)
+      continue;
+
+    offsets.push_back(feat_r*cols + feat_c);
+    pt_idx.push_back(img_feats[i].idx);
+  }
+}
+
+/**
+Function projects single channel 2D change mask into 3D using the precomputed feature pixels of its camera. The mask is only read, hits are recorded in the bitset of 3D points so concurrent calls may share it. Points are appended to out_pts.
+*/
+void ImgIO::projChngMaskCorr(const cv::Mat &chng_mask, const FeaturePixelIndex &feat_index, const std::vector<PtCamCorr> &pts_corr, AtomicBitset &hits, std::vector<vcg::Point3f> &out_pts){
+
+  if(chng_mask.type() != CV_8UC1 || chng_mask.rows != feat_index.rows || chng_mask.cols != feat_index.cols){
+    std::cout<<"Change mask has to be single channel and of the size of its feature index!"<<std::endl;
+    return;
+  }
+
+  const bool continuous = chng_mask.isContinuous();
+  const uchar *data = chng_mask.data;
+
+  for(int i = 0 ; i < feat_index.size(); i++){
+    const int offset = feat_index.offsets[i];
+    const uchar value = continuous ? data[offset] : chng_mask.ptr<uchar>(offset / feat_index.cols)[offset % feat_index.cols];
+
+    if(value > 0){
+      hits.set(feat_index.pt_idx[i]);
+      out_pts.push_back(pts_corr[feat_index.pt_idx[i]].pts_3d);
+    }
+  }
+}
+
 /**
    Function projects 2D change mask into 3-dimensional space using point cloud voxelization and computation of ray intersections with the voxels
 */
 std::vector<vcg::Point3f> ImgIO::projChngMask(const std::string &filename, const cv::Mat &chng_mask, const vcg::Shot<float> &shot, double resolution){
+  return projChngMask(filename, chng_mask, ImgFootprint(chng_mask.size()), shot, resolution);
+}
+
+/**
+   Function projects 2D change mask into 3-dimensional space using ray shooting, rays are shot only from the footprint of the mask
+*/
+std::vector<vcg::Point3f> ImgIO::projChngMask(const std::string &filename, const cv::Mat &chng_mask, const ImgFootprint &footprint, const vcg::Shot<float> &shot, double resolution){
+  return projChngMask(filename, SpanMask(chng_mask, footprint), shot, resolution);
+}
+
+/**
+   Function projects run-length encoded 2D change mask into 3-dimensional space using ray shooting. The model is voxelized for this call only, use the OccupancyGrid overload when projecting several masks.
+*/
+std::vector<vcg::Point3f> ImgIO::projChngMask(const std::string &filename, const SpanMask &chng_mask, const vcg::Shot<float> &shot, double resolution){
+  return projChngMask(OccupancyGrid(filename, resolution), chng_mask, shot);
+}
+
+/**
+   Function projects run-length encoded 2D change mask into 3-dimensional space by shooting rays into a prebuilt occupancy grid. Rays are generated span by span.
+*/
+std::vector<vcg::Point3f> ImgIO::projChngMask(const OccupancyGrid &grid, const SpanMask &chng_mask, const vcg::Shot<float> &shot){
   
   std::cout<<"Projecting 2D change mask into 3D space using ray shooting..." <<std::endl;
   std::vector<vcg::Point3f> out_pts;
-  std::vector<cv::Point2f> mask_pts;
-  rayBox voxel_grid;
-  Eigen::Vector4f origin;
-  Eigen::Vector4f origin2;
   vcg::Point3f tmp_pt;
   double prog_perc = 0;
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-  
-  MeshIO::getPlyFilePCL(filename, cloud);
-
-  shot.Extrinsics.Tra().ToEigenVector(origin2);
-
-  voxel_grid.setInputCloud(cloud);
-  voxel_grid.setLeafSize (resolution, resolution, resolution);
-  voxel_grid.initializeVoxelGrid();
- 
-  voxel_grid.setSensorOrigin(origin2);
-
-  getPtsFromMask(chng_mask, mask_pts);
+  const CameraRayGenerator ray_gen(shot);
+  const Eigen::Vector4f &origin = ray_gen.getOrigin();
 
-  shot.Extrinsics.Tra().ToEigenVector(origin);  
+  const std::vector<MaskSpan> &spans = chng_mask.getSpans();
+  std::size_t done_pts = 0;
+  std::vector<float> dir_x, dir_y, dir_z;
     
-  for(int i = 0 ; i < mask_pts.size(); i++){
+  for(int s = 0 ; s < spans.size(); s++){
     
-    if(i % 100 == 0){
-      prog_perc = double(i)/double(mask_pts.size());
+    if(s % 100 == 0){
+      prog_perc = double(done_pts)/double(chng_mask.count());
       DrawProgressBar(40, prog_perc);
     }
 
-    Eigen::Vector4f direction;
-    vcg::Point3f tmp_dir = shot.UnProject(vcg::Point2f(mask_pts[i].y, mask_pts[i].x), 100);
+    const MaskSpan &span = spans[s];
+    done_pts += span.size();
+
+    dir_x.resize(span.size());
+    dir_y.resize(span.size());
+    dir_z.resize(span.size());
+    ray_gen.generateSpan(span.row, span.first, span.last, &dir_x[0], &dir_y[0], &dir_z[0]);
 
-    tmp_dir.ToEigenVector(direction);
+    for(int k = 0 ; k < span.size() ; k++){
 
-    float tmp_mp = voxel_grid.getBoxIntersection(origin, direction);
+      Eigen::Vector4f direction(dir_x[k], dir_y[k], dir_z[k], 0);
+
+      float tmp_mp = grid.getBoxIntersection(origin, direction);
       
-    if(tmp_mp == -1.0f){
-      continue;
-    }
+      if(tmp_mp == -1.0f){
+	continue;
+      }
     
-    int cloud_idx = -1;
-
-    cloud_idx = voxel_grid.getFirstOccl(origin, direction, tmp_mp);
+      int cloud_idx = grid.getFirstOccl(origin, direction, tmp_mp);
     
-    if(cloud_idx!=-1){
-      pcl::PointXYZ fin_pt = cloud->points[cloud_idx];
-      
-      tmp_pt = PclProcessing::pcl2vcgPt(fin_pt);    
-      out_pts.push_back(tmp_pt);
+      if(cloud_idx!=-1){
+	tmp_pt = PclProcessing::pcl2vcgPt(grid.getPoint(cloud_idx));    
+	out_pts.push_back(tmp_pt);
+      }
     }
   } 
 
@@ -256,10 +417,27 @@ std::vector<vcg::Point3f> ImgIO::projChngMask(const std::string &filename, const
    Function projects 2D change mask into 3-dimensional space using triangulation.
 */
 cv::Mat ImgIO::projChngMaskTo3D(const cv::Mat &chngMask, const vcg::Shot<float> &cam1, const vcg::Shot<float> &cam2, const cv::Mat &H){
+  return projChngMaskTo3D(chngMask, ImgFootprint(chngMask.size()), cam1, cam2, H);
+}
+
+/**
+   Function projects 2D change mask into 3-dimensional space using triangulation of the points lying in the footprint.
+*/
+cv::Mat ImgIO::projChngMaskTo3D(const cv::Mat &chngMask, const ImgFootprint &footprint, const vcg::Shot<float> &cam1, const vcg::Shot<float> &cam2, const cv::Mat &H){
+  return projChngMaskTo3D(SpanMask(chngMask, footprint), cam1, cam2, H);
+}
+
+/**
+   Function projects run-length encoded 2D change mask into 3-dimensional space using triangulation.
+*/
+cv::Mat ImgIO::projChngMaskTo3D(const SpanMask &chngMask, const vcg::Shot<float> &cam1, const vcg::Shot<float> &cam2, const cv::Mat &H){
   
   std::vector<cv::Point2f> cam1_points, cam2_points;
 
-  getPtsFromMask(chngMask, cam1_points);
+  chngMask.getPoints(cam1_points);
+
+  if(cam1_points.empty())
+    return cv::Mat(4, 0, CV_32F);
   
   cv::Mat cam1_fmat;
   cv::Mat cam2_fmat;
@@ -282,6 +460,23 @@ cv::Mat ImgIO::projChngMaskTo3D(const cv::Mat &chngMask, const vcg::Shot<float>
   return pnts3D;
 }
 
+/**
+   Function projects run-length encoded 2D change mask into 3-dimensional space using batched float triangulation. Points behind the cameras or with reprojection error above max_reproj_err pixels are dropped.
+*/
+void ImgIO::projChngMaskTo3D(const SpanMask &chngMask, const vcg::Shot<float> &cam1, const vcg::Shot<float> &cam2, const cv::Mat &H, std::vector<vcg::Point3f> &out_pts, float max_reproj_err){
+
+  std::vector<cv::Point2f> cam1_points, cam2_points;
+
+  chngMask.getPoints(cam1_points);
+
+  if(cam1_points.empty())
+    return;
+
+  cv::perspectiveTransform(cam1_points, cam2_points, H);
+
+  Triangulator(cam1, cam2, max_reproj_err).triangulate(cam1_points, cam2_points, out_pts);
+}
+
 /**
    Class responsible for Input/Output operations.
 */
@@ -591,7 +786,7 @@ void readCmdInput(std::map<int,std::string> &inStrings, int argc, char** argv){
   tfnd = 0;
   flags = 0;
   
-  while ((opt = getopt(argc, argv, "m:p:b:i:o:n")) != -1) {
+  while ((opt = getopt(argc, argv, "m:p:b:i:o:n:k:x:c:r:f:a:s:d:g:l:e:")) != -1) {
     switch (opt) {
 	
     case 'm':
@@ -609,9 +804,45 @@ void readCmdInput(std::map<int,std::string> &inStrings, int argc, char** argv){
     case 'o':
       inStrings[OUTDIR] = optarg;
       break;
+    case 'n':
+      inStrings[NVM] = optarg;
+      break;
+    case 'k':
+      inStrings[MASKIMG] = optarg;
+      break;
+    case 'x':
+      inStrings[CHANGEMASK] = optarg;
+      break;
+    case 'c':
+      inStrings[CAMERA] = optarg;
+      break;
+    case 'r':
+      inStrings[VOXRES] = optarg;
+      break;
+    case 'f':
+      inStrings[FUSEVOTES] = optarg;
+      break;
+    case 'a':
+      inStrings[MINAREA] = optarg;
+      break;
+    case 's':
+      inStrings[RAYSTRIDE] = optarg;
+      break;
+    case 'd':
+      inStrings[RAYDEPTH] = optarg;
+      break;
+    case 'g':
+      inStrings[MRFSOLVER] = optarg;
+      break;
+    case 'l':
+      inStrings[MRFALPHA] = optarg;
+      break;
+    case 'e':
+      inStrings[FEATGROUPING] = optarg;
+      break;
 	
     default: /* '?' */
-      fprintf(stderr, "Usage: %s [-m input mesh] [-p input PMVS] [-b input bundler file] [-i input image list]\n",
+      fprintf(stderr, "Usage: %s [-m input mesh] [-p input PMVS] [-b input bundler file] [-i input image list] [-n input NVM] [-k change mask image] [-x change mask cloud] [-c camera index] [-r voxel resolution] [-f neighbour masks voting for a change pixel] [-a minimum change component area] [-s adaptive ray stride] [-d adaptive ray refinement depth] [-g MRF solver, 0 serial 1 parallel, without it the solvers are benchmarked] [-l MRF weight of change votes] [-e feature grouping, 0 batch 1 incremental]\n",
 	      argv[0]);
     }
   }
@@ -630,11 +861,11 @@ void getPlyFileVcg(std::string filename, MyMesh &m){
   std::cout<<"Mesh loaded correctly. No. of faces:"<<m.FN()<<" no. of vertices:"<<m.VN()<<std::endl;
 }
 
-void savePlyFileVcg(std::string filename, MyMesh &m){
+void savePlyFileVcg(std::string filename, MyMesh &m, int mask){
   
   vcg::tri::io::ExporterPLY<MyMesh> exportVar;
 
-  exportVar.Save(m,filename.c_str(),vcg::tri::io::Mask::IOM_VERTCOLOR);
+  exportVar.Save(m,filename.c_str(),mask);
 
 }
 
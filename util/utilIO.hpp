@@ -10,6 +10,8 @@
 
 #include <pcl/io/pcd_io.h>
 #include <pcl/io/ply_io.h>
+#include <pcl/conversions.h>
+#include <pcl/common/io.h>
 #include <pcl/point_types.h>
 #include <pcl/kdtree/kdtree_flann.h>
 
@@ -27,6 +29,63 @@ struct PtCamCorrespondence{
 
 };
 
+/**
+   Part of an image that overlaps the other image of a registered pair. Spans are half-open [first, second) column ranges, one per row of the bounding box.
+*/
+struct ImgFootprint{
+  std::vector<cv::Point2f> quad;
+  cv::Rect bbox;
+  std::vector<std::pair<int,int> > spans;
+
+  ImgFootprint(){}
+
+  ImgFootprint(const cv::Size &size){
+    quad.push_back(cv::Point2f(0, 0));
+    quad.push_back(cv::Point2f(size.width-1, 0));
+    quad.push_back(cv::Point2f(size.width-1, size.height-1));
+    quad.push_back(cv::Point2f(0, size.height-1));
+    bbox = cv::Rect(0, 0, size.width, size.height);
+    spans.assign(size.height, std::pair<int,int>(0, size.width));
+  }
+
+  bool empty() const {return bbox.width<=0 || bbox.height<=0;}
+
+  int area() const {
+    int n = 0;
+    for(int r = 0 ; r < spans.size() ; r++)
+      n += std::max(0, spans[r].second - spans[r].first);
+    return n;
+  }
+
+  bool contains(int x, int y) const {
+    if(y < bbox.y || y >= bbox.y+bbox.height)
+      return false;
+    const std::pair<int,int> &span = spans[y-bbox.y];
+    return x >= span.first && x < span.second;
+  }
+};
+
+/**
+   Pixels of the features of one camera as offsets into a continuous mask of the camera image size. Features outside of the image are left out. Built once per camera and shared by all masks of that camera.
+*/
+struct FeaturePixelIndex{
+  int rows;
+  int cols;
+  std::vector<int> offsets;
+  //Index of the 3D point observed by each feature
+  std::vector<int> pt_idx;
+
+  FeaturePixelIndex() : rows(0), cols(0){}
+  FeaturePixelIndex(const std::vector<ImgFeature> &img_feats, const cv::Size &size);
+
+  std::size_t size() const {return offsets.size();}
+};
+
+class SpanMask;
+class OccupancyGrid;
+class AtomicBitset;
+class VoxelAccumulator;
+
 /*
 To run VisualSFM:
 
@@ -50,6 +109,8 @@ class MeshIO : public ChangeDetectorIO{
 public:
   MeshIO() : ChangeDetectorIO(){};
   static void saveChngMask3d(const std::vector<std::vector<vcg::Point3f> >&, const std::vector<vcg::Color4b>&, const std::string&);
+  static void saveChngMask3d(const VoxelAccumulator&, const std::string&);
+  static void getChngMaskVotes(const std::string&, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr, std::vector<int>&);
 
   template <typename T>
   static void getPlyFilePCL(const std::string filename, boost::shared_ptr<pcl::PointCloud<T> > outCloud){  
@@ -68,13 +129,23 @@ public:
   ImgIO() : ChangeDetectorIO(){};
   static void dispImgs(const std::vector<cv::Mat>&);
   static void getPtsFromMask(const cv::Mat&, std::vector<cv::Point2f>&);
+  static void getPtsFromMask(const cv::Mat&, const ImgFootprint&, std::vector<cv::Point2f>&);
   static cv::Mat projChngMaskTo3D(const cv::Mat&, const vcg::Shot<float>&, const vcg::Shot<float>&, const cv::Mat&);
+  static cv::Mat projChngMaskTo3D(const cv::Mat&, const ImgFootprint&, const vcg::Shot<float>&, const vcg::Shot<float>&, const cv::Mat&);
+  static cv::Mat projChngMaskTo3D(const SpanMask&, const vcg::Shot<float>&, const vcg::Shot<float>&, const cv::Mat&);
+  static void projChngMaskTo3D(const SpanMask&, const vcg::Shot<float>&, const vcg::Shot<float>&, const cv::Mat&, std::vector<vcg::Point3f>&, float max_reproj_err = 4.0f);
   static std::vector<vcg::Point3f> projChngMask(const std::string&, const cv::Mat&, const vcg::Shot<float>&, double);
+  static std::vector<vcg::Point3f> projChngMask(const std::string&, const cv::Mat&, const ImgFootprint&, const vcg::Shot<float>&, double);
+  static std::vector<vcg::Point3f> projChngMask(const std::string&, const SpanMask&, const vcg::Shot<float>&, double);
+  static std::vector<vcg::Point3f> projChngMask(const OccupancyGrid&, const SpanMask&, const vcg::Shot<float>&);
   static cv::Mat getRtMatrix(const vcg::Shot<float>&);
   static cv::Mat getIntrMatrix(const vcg::Shot<float>&);
   static int getKNNcamData(const pcl::KdTreeFLANN<pcl::PointXYZ>&, pcl::PointXYZ&, const std::vector<std::string>&, std::vector<cv::Mat>&, int K, std::vector<int>&);
 
   static std::vector<vcg::Point3f> projChngMaskCorr(const cv::Mat&, const std::vector<ImgFeature>&, const std::vector<PtCamCorr>&, std::set<int>&);
+  static std::vector<vcg::Point3f> projChngMaskCorr(const cv::Mat&, const ImgFootprint&, const std::vector<ImgFeature>&, const std::vector<PtCamCorr>&, std::set<int>&);
+  static std::vector<vcg::Point3f> projChngMaskCorr(const SpanMask&, const std::vector<ImgFeature>&, const std::vector<PtCamCorr>&, std::set<int>&);
+  static void projChngMaskCorr(const cv::Mat&, const FeaturePixelIndex&, const std::vector<PtCamCorr>&, AtomicBitset&, std::vector<vcg::Point3f>&);
 
 };
 
@@ -115,7 +186,7 @@ void readCmdInput(std::map<int,std::string> &inputStrings, int argc, char** argv
 
 void getPlyFileVcg(std::string filename, MyMesh &m);
 
-void savePlyFileVcg(std::string filename, MyMesh &m);
+void savePlyFileVcg(std::string filename, MyMesh &m, int mask = vcg::tri::io::Mask::IOM_VERTCOLOR);
 
 void getBundlerFile(std::string filename);
 
@@ -0,0 +1,133 @@
+#include "voxelAccumulator.hpp"
+
+#include <cmath>
+
+// voxel coordinates are packed into 21 bits per axis
+static const int KEY_BITS = 21;
+static const long long KEY_OFFSET = 1LL << (KEY_BITS - 1);
+static const unsigned long long KEY_MASK = (1ULL << KEY_BITS) - 1;
+
+VoxelAccumulator::VoxelAccumulator(double in_resolution) : resolution(in_resolution), inv_resolution(1.0f/in_resolution), n_calls(0), shards(SHARD_COUNT){
+
+#ifdef _OPENMP
+  locks.resize(SHARD_COUNT);
+  for(int s = 0 ; s < SHARD_COUNT ; s++)
+    omp_init_lock(&locks[s]);
+#endif
+}
+
+VoxelAccumulator::~VoxelAccumulator(){
+
+#ifdef _OPENMP
+  for(int s = 0 ; s < SHARD_COUNT ; s++)
+    omp_destroy_lock(&locks[s]);
+#endif
+}
+
+/**
+   Function returns hash key of the voxel containing the point
+*/
+unsigned long long VoxelAccumulator::getKey(const vcg::Point3f &pt) const{
+
+  unsigned long long key = 0;
+  for(int d = 0 ; d < 3 ; d++){
+    long long coord = static_cast<long long>(std::floor(pt[d]*inv_resolution)) + KEY_OFFSET;
+    key = (key << KEY_BITS) | (static_cast<unsigned long long>(coord) & KEY_MASK);
+  }
+  return key;
+}
+
+/**
+   Function spreads neighbouring voxels over the shards
+*/
+int VoxelAccumulator::getShard(unsigned long long key){
+  return static_cast<int>((key * 0x9E3779B97F4A7C15ULL) >> (64 - SHARD_BITS));
+}
+
+/**
+   Function adds all change points of one image pair, every voxel they hit gets one vote. Points are grouped by shard first so every shard is locked once per call.
+*/
+void VoxelAccumulator::add(const std::vector<vcg::Point3f> &pts){
+
+  const int n_pts = pts.size();
+  //Calls are numbered so concurrent pairs vote independently
+  const int call_id = __sync_fetch_and_add(&n_calls, 1);
+
+  std::vector<unsigned long long> keys(n_pts);
+  std::vector<int> shard_first(SHARD_COUNT + 1, 0);
+
+  for(int i = 0 ; i < n_pts ; i++){
+    keys[i] = getKey(pts[i]);
+    shard_first[getShard(keys[i]) + 1]++;
+  }
+
+  for(int s = 0 ; s < SHARD_COUNT ; s++)
+    shard_first[s+1] += shard_first[s];
+
+  std::vector<int> order(n_pts);
+  std::vector<int> shard_fill(shard_first.begin(), shard_first.end() - 1);
+  for(int i = 0 ; i < n_pts ; i++)
+    order[shard_fill[getShard(keys[i])]++] = i;
+
+  for(int s = 0 ; s < SHARD_COUNT ; s++){
+
+    if(shard_first[s] == shard_first[s+1])
+      continue;
+
+#ifdef _OPENMP
+    omp_set_lock(&locks[s]);
+#endif
+
+    for(int k = shard_first[s] ; k < shard_first[s+1] ; k++){
+      VoxelVotes &voxel = shards[s][keys[order[k]]];
+      voxel.sum += pts[order[k]];
+      voxel.points++;
+      if(voxel.last_call != call_id){
+	voxel.votes++;
+	voxel.last_call = call_id;
+      }
+    }
+
+#ifdef _OPENMP
+    omp_unset_lock(&locks[s]);
+#endif
+  }
+}
+
+/**
+   Function returns centroids of the voxels voted for by at least min_votes image pairs and their vote counts
+*/
+void VoxelAccumulator::getPoints(std::vector<vcg::Point3f> &out_pts, std::vector<int> &out_votes, int min_votes) const{
+
+  out_pts.reserve(out_pts.size() + size());
+  out_votes.reserve(out_votes.size() + size());
+
+  for(int s = 0 ; s < SHARD_COUNT ; s++){
+    boost::unordered_map<unsigned long long, VoxelVotes>::const_iterator it;
+    for(it = shards[s].begin() ; it != shards[s].end() ; ++it){
+      if(it->second.votes < min_votes)
+	continue;
+      out_pts.push_back(it->second.sum / static_cast<float>(it->second.points));
+      out_votes.push_back(it->second.votes);
+    }
+  }
+}
+
+std::size_t VoxelAccumulator::size() const{
+
+  std::size_t total = 0;
+  for(int s = 0 ; s < SHARD_COUNT ; s++)
+    total += shards[s].size();
+  return total;
+}
+
+std::size_t VoxelAccumulator::getPointCount() const{
+
+  std::size_t total = 0;
+  for(int s = 0 ; s < SHARD_COUNT ; s++){
+    boost::unordered_map<unsigned long long, VoxelVotes>::const_iterator it;
+    for(it = shards[s].begin() ; it != shards[s].end() ; ++it)
+      total += it->second.points;
+  }
+  return total;
+}
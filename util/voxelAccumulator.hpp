@@ -0,0 +1,63 @@
+#ifndef __VOXELACCUMULATOR_H_INCLUDED__
+#define __VOXELACCUMULATOR_H_INCLUDED__
+
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include "../common/common.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+   Votes of the 3D change points falling into one voxel. Points are summed so the voxel is represented by their centroid. The vote is the number of add() calls, i.e. image pairs, that hit the voxel, however many pixels of a pair project into it.
+*/
+struct VoxelVotes{
+  vcg::Point3f sum;
+  int points;
+  int votes;
+  //add() call which last voted for the voxel
+  int last_call;
+
+  VoxelVotes() : sum(0, 0, 0), points(0), votes(0), last_call(-1){}
+};
+
+/**
+   Accumulator of the 3D change points of all image pairs of a run, hashed by their quantized position. The hash is split into shards with a lock each, so masks of different pairs can be added from several threads. Memory depends on the number of occupied voxels, not on the number of pairs.
+*/
+class VoxelAccumulator{
+
+public:
+  static const int SHARD_BITS = 6;
+  static const int SHARD_COUNT = 1 << SHARD_BITS;
+
+  VoxelAccumulator(double in_resolution);
+  ~VoxelAccumulator();
+
+  void add(const std::vector<vcg::Point3f> &pts);
+  void getPoints(std::vector<vcg::Point3f> &out_pts, std::vector<int> &out_votes, int min_votes = 1) const;
+
+  std::size_t size() const;
+  std::size_t getPointCount() const;
+  double getResolution() const {return resolution;}
+
+private:
+  //Shards are locked individually, copying would duplicate the locks
+  VoxelAccumulator(const VoxelAccumulator&);
+  VoxelAccumulator& operator=(const VoxelAccumulator&);
+
+  unsigned long long getKey(const vcg::Point3f &pt) const;
+  static int getShard(unsigned long long key);
+
+  double resolution;
+  float inv_resolution;
+  int n_calls;
+  std::vector<boost::unordered_map<unsigned long long, VoxelVotes> > shards;
+#ifdef _OPENMP
+  std::vector<omp_lock_t> locks;
+#endif
+};
+
+#endif